@@ -225,7 +225,8 @@ void main(int argc, char* argv[])
 	auto swapchainExt = true;
 	auto mirrorClapToEdgeExt = false;
 
-	auto devices = IDevice::enumerateDevices(*surface, { anisotropicFeature }, { swapchainExt, mirrorClapToEdgeExt });
+	auto bcCompressionFeature = false;
+	auto devices = IDevice::enumerateDevices(*surface, { anisotropicFeature, bcCompressionFeature, testConfig.pipelineStatistics }, { swapchainExt, mirrorClapToEdgeExt });
 	auto& device = devices[0];
 
 	auto& swapchain = device->createSwapChain(Format::eR8G8B8A8Unorm, Format::eD32Sfloat, 3, IDevice::PresentMode::eMailbox);
@@ -282,6 +283,8 @@ void main(int argc, char* argv[])
 
 	auto graphicsQueue = device->createGraphicsQueue();
 
+	auto modelSlot = parameterBlock->dynamicSlot("model");
+
 	auto subCmdRecs = std::vector<std::function<void(IRecordingSubCommandBuffer& rcmd)>>(testConfig.drawThreadCount);
 	for (auto i = 0; i < testConfig.drawThreadCount; ++i) {
 		subCmdRecs[i] = [&, i](IRecordingSubCommandBuffer& rcmd) {
@@ -298,15 +301,29 @@ void main(int argc, char* argv[])
 				roCount += scene.renderObjects().size() % threadCount;
 			}
 
+			if (testConfig.pipelineStatistics) {
+				rcmd.beginPipelineStatistics("thread " + std::to_string(i));
+			}
+
 			for (auto j = 0; j < roCount; ++j) {
-				rcmd.setDynamicIndex(*parameterBlock, "model", i * stride + j);
+				rcmd.setDynamicIndex(modelSlot, i * stride + j);
 				rcmd.drawIndexed(indices.size());
 			}
+
+			if (testConfig.pipelineStatistics) {
+				rcmd.endPipelineStatistics();
+			}
 		};
 	}
 
+	// The draws of a thread don't change from frame to frame, only the content of the uniform buffers does.
 	auto threadPoolEnqueuFunc = [&](std::reference_wrapper<ISubCommandBuffer> cmd, int threadIndex) {
-		cmd.get().record(*renderpass, subCmdRecs[threadIndex]);
+		if (testConfig.reuseCommandBuffers) {
+			cmd.get().recordOnce(*renderpass, subCmdRecs[threadIndex]);
+		}
+		else {
+			cmd.get().record(*renderpass, subCmdRecs[threadIndex]);
+		}
 	};
 
 
@@ -353,6 +370,8 @@ void main(int argc, char* argv[])
 		wmiAccessor.Connect("OpenHardwareMonitor");
 	}
 	DataCollection<WMIDataItem> wmiCollection;
+	DataCollection<PipelineStatisticsDataItem> pipelineStatisticsCollection;
+	auto pipelineStatisticsCount = 0;
 
 	auto runTime = Clock::now() - startTime;
 	auto currentDataCount = 0;
@@ -407,6 +426,26 @@ void main(int argc, char* argv[])
 					frametimeCsv << frameTimeCount << "\n";
 					++currentDataCount;
 				}
+
+				//the counters are those of the newest frame the GPU has finished, a few frames behind the frame time
+				if (testConfig.pipelineStatistics) {
+					for (auto& scmd : subCmds) {
+						for (auto& statistics : scmd->getPipelineStatistics()) {
+							PipelineStatisticsDataItem item;
+							item.Id = std::to_string(pipelineStatisticsCount);
+							item.FrameTime = std::to_string(frameTimeCount);
+							item.CommandListId = statistics.name;
+							item.IAVertices = std::to_string(statistics.inputAssemblyVertices);
+							item.IAPrimitives = std::to_string(statistics.inputAssemblyPrimitives);
+							item.VSInvocations = std::to_string(statistics.vertexShaderInvocations);
+							item.CInvocations = std::to_string(statistics.clippingInvocations);
+							item.CPrimitives = std::to_string(statistics.clippingPrimitives);
+							item.PSInvocations = std::to_string(statistics.fragmentShaderInvocations);
+							pipelineStatisticsCollection.Add(item);
+						}
+					}
+					++pipelineStatisticsCount;
+				}
 			}
 
 			//OHM
@@ -428,9 +467,8 @@ void main(int argc, char* argv[])
 			}
 
 		
-			std::vector<glm::mat4> dynamicBufferData;
-			dynamicBufferData.reserve(scene.renderObjects().size());
 			//dynamic uniform buffer:
+			auto dynamicBufferWriter = model->beginWrite<glm::mat4>();
 			for (auto index = 0; index < scene.renderObjects().size(); index++)
 			{
 				auto& render_object = scene.renderObjects()[index];
@@ -448,10 +486,10 @@ void main(int argc, char* argv[])
 					newModel = glm::rotate<float>(newModel, render_object.m_RotationAngle * 3.14159268 / 180, glm::tvec3<float>{ rotateX, rotateY, rotateZ });
 				}
 
-				dynamicBufferData.push_back(newModel);
+				dynamicBufferWriter[index] = newModel;
 			}
 
-			model->upload(dynamicBufferData);
+			dynamicBufferWriter.flush();
 
 			//record commands
 			std::vector<std::future<void>> futures;
@@ -515,6 +553,10 @@ void main(int argc, char* argv[])
 		SaveToFile("fps_" + fname + ".csv", fpsCsv.str());
 	}
 
+	if (testConfig.pipelineStatistics) {
+		SaveToFile("pipelineStatistics_" + fname + ".csv", pipelineStatisticsCollection.MakeString(";"));
+	}
+
 	if (testConfig.recordFrameTime) {
 		SaveToFile("frameTime_" + fname + ".csv", frametimeCsv.str());
 	}
@@ -49,7 +49,9 @@ public:
 		IAVertices,
 		PSInvocations,
 		VSInvocations,
-		CommandListId;
+		CommandListId,
+		Id,
+		FrameTime;
 };
 
 template<class T>
@@ -131,6 +133,8 @@ inline std::string DataCollection<PipelineStatisticsDataItem>::MakeString(std::s
 	std::stringstream result;
 
 	//csv headers:
+	result << "Id" << seperator;
+	result << "FrameTime" << seperator;
 	result << "CommandListId" << seperator;
 	result << "CInvocations" << seperator;
 	result << "CPrimitives" << seperator;
@@ -146,6 +150,8 @@ inline std::string DataCollection<PipelineStatisticsDataItem>::MakeString(std::s
 
 	//data:
 	for (auto& item : items) {
+		result << item.Id << seperator;
+		result << item.FrameTime << seperator;
 		result << item.CommandListId << seperator;
 		result << item.CInvocations << seperator;
 		result << item.CPrimitives << seperator;
@@ -5,6 +5,24 @@ enum class Format {
 	eR8G8B8A8Unorm,
 	eB8G8R8A8Unorm,
 
+	// Block compressed, 4x4 texels per block. Requires IDevice::Features::textureCompressionBC.
+	eBc1RgbUnormBlock,
+	eBc1RgbSrgbBlock,
+	eBc1RgbaUnormBlock,
+	eBc1RgbaSrgbBlock,
+	eBc2UnormBlock,
+	eBc2SrgbBlock,
+	eBc3UnormBlock,
+	eBc3SrgbBlock,
+	eBc4UnormBlock,
+	eBc4SnormBlock,
+	eBc5UnormBlock,
+	eBc5SnormBlock,
+	eBc6HUfloatBlock,
+	eBc6HSfloatBlock,
+	eBc7UnormBlock,
+	eBc7SrgbBlock,
+
 	eS8Uint,
 	eD32Sfloat,
 	eD32SfloatS8Uint,
@@ -57,6 +75,12 @@ enum class BufferResourceElementType		//<-- Used when BufferResource is an index
 	eUint32
 };
 
+enum class BufferMemoryPlacement		//<-- Used when creating vertex and index buffers.
+{
+	eDeviceLocal,	//<-- filled through staging copies. Fastest for static geometry.
+	eHostVisible	//<-- written directly by the host. For buffers rewritten every frame.
+};
+
 //TODO: make in-accessible to user? (only used internally)
 enum class DepthStencilFlags
 {
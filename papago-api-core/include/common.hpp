@@ -1,5 +1,7 @@
 #pragma once
-#ifdef PAPAGO_EXPORT
+#ifndef _WIN32
+#define PAPAGO_API
+#elif defined(PAPAGO_EXPORT)
 #define PAPAGO_API __declspec(dllexport)
 #else
 #define PAPAGO_API __declspec(dllimport)
@@ -1,12 +1,46 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+class IDynamicBufferResource;
+
+// Writes objects straight into the aligned slots of a dynamic buffer, returned by IDynamicBufferResource::beginWrite.
+// Only the range of slots that have been written is flushed when the writer is destroyed.
+template<typename T>
+class DynamicBufferWriter
+{
+public:
+	DynamicBufferWriter(IDynamicBufferResource& buffer, char* data, size_t alignment, size_t count);
+	DynamicBufferWriter(DynamicBufferWriter&& other) noexcept;
+	DynamicBufferWriter(const DynamicBufferWriter&) = delete;
+	~DynamicBufferWriter();
+
+	T& operator[](size_t index);
+	size_t size() const { return m_count; }
+
+	// Flushes the slots written so far. Called automatically when the writer is destroyed.
+	void flush();
+
+private:
+	IDynamicBufferResource* m_buffer;
+	char* m_data;
+	size_t m_alignment;
+	size_t m_count;
+	size_t m_dirtyBegin;
+	size_t m_dirtyEnd;
+};
 
 class IDynamicBufferResource
 {
 public:
 	virtual ~IDynamicBufferResource() = default;
 
+	template<typename T>
+	DynamicBufferWriter<T> beginWrite();
+
 	template<typename T>
 	void upload(const std::vector<T>& data);
 
@@ -21,8 +55,38 @@ public:
 
 private:
 	virtual std::vector<char> internalDownload() = 0;
-	virtual void internalUpload(const std::vector<char>&, size_t offset) = 0;
+	virtual char* internalBeginWrite() = 0;
+	virtual void internalEndWrite(size_t offset, size_t size) = 0;
 	virtual size_t getAlignment() = 0;
+	virtual size_t getObjectCount() = 0;
+
+	template<typename T>
+	friend class DynamicBufferWriter;
+};
+
+class IBufferResource;
+
+// Writable view of a buffer's memory, returned by IBufferResource::map.
+// Host visible buffers are written directly; other buffers are uploaded when the view is destroyed.
+template<typename T>
+class MappedBuffer
+{
+public:
+	MappedBuffer(IBufferResource& buffer, T* data, size_t count);
+	MappedBuffer(MappedBuffer&& other) noexcept;
+	MappedBuffer(const MappedBuffer&) = delete;
+	~MappedBuffer();
+
+	T& operator[](size_t index) { return m_data[index]; }
+	T* data() { return m_data; }
+	size_t size() const { return m_count; }
+	T* begin() { return m_data; }
+	T* end() { return m_data + m_count; }
+
+private:
+	IBufferResource* m_buffer;
+	T* m_data;
+	size_t m_count;
 };
 
 class IBufferResource {
@@ -32,30 +96,39 @@ public:
 	template<typename T>
 	void upload(const std::vector<T>& data);
 
+	template<typename T>
+	void upload(const T* data, size_t count, size_t offset = 0);
+
 	template<typename T = char>
 	std::vector<T> download();
 
+	template<typename T>
+	MappedBuffer<T> map();
+
 	virtual bool inUse() = 0;
 protected:
-	virtual void internalUpload(const std::vector<char>& data) = 0;
+	virtual void internalUpload(const void* data, size_t size, size_t offset) = 0;
 	virtual std::vector<char> internalDownload() = 0;
+	virtual void* internalMap() = 0;
+	virtual void internalUnmap() = 0;
+	virtual size_t getSize() const = 0;
+
+	template<typename T>
+	friend class MappedBuffer;
 };
 
-template<>
-inline void IBufferResource::upload<char>(const std::vector<char>& data)
+template<typename T>
+void IBufferResource::upload(const std::vector<T>& data)
 {
-	internalUpload(data);
+	upload(data.data(), data.size());
 }
 
 template<typename T>
-void IBufferResource::upload(const std::vector<T>& data)
+void IBufferResource::upload(const T* data, size_t count, size_t offset)
 {
-	std::vector<char> buffer(sizeof(T)*data.size());
-	memcpy(buffer.data(), data.data(), buffer.size());
-	internalUpload(buffer);
+	internalUpload(data, sizeof(T) * count, offset);
 }
 
-
 template<>
 inline std::vector<char> IBufferResource::download<char>()
 {
@@ -68,37 +141,119 @@ std::vector<T> IBufferResource::download()
 	auto data = internalDownload();
 	std::vector<T> buffer;
 	buffer.resize(data.size() / sizeof(T));
-	memcpy(buffer.data(), data.data(), sizeof(T));
+	memcpy(buffer.data(), data.data(), buffer.size() * sizeof(T));
 	return buffer;
 }
 
 template<typename T>
-inline void IDynamicBufferResource::upload(const std::vector<T>& data)
+MappedBuffer<T> IBufferResource::map()
+{
+	return MappedBuffer<T>(*this, static_cast<T*>(internalMap()), getSize() / sizeof(T));
+}
+
+template<typename T>
+MappedBuffer<T>::MappedBuffer(IBufferResource& buffer, T* data, size_t count)
+	: m_buffer(&buffer)
+	, m_data(data)
+	, m_count(count)
+{
+}
+
+template<typename T>
+MappedBuffer<T>::MappedBuffer(MappedBuffer&& other) noexcept
+	: m_buffer(other.m_buffer)
+	, m_data(other.m_data)
+	, m_count(other.m_count)
+{
+	other.m_buffer = nullptr;
+}
+
+template<typename T>
+MappedBuffer<T>::~MappedBuffer()
+{
+	if (m_buffer) {
+		m_buffer->internalUnmap();
+	}
+}
+
+template<typename T>
+inline DynamicBufferWriter<T> IDynamicBufferResource::beginWrite()
 {
 	auto alignment = getAlignment();
-	std::vector<char> result(data.size() * alignment);
-	auto size = sizeof(T);
-	for (auto index = 0, offset = 0; index < data.size(); ++index, offset += alignment)
-	{
-		memcpy(&result[offset], &data[index], sizeof(T));
+	if (sizeof(T) > alignment) {
+		throw std::runtime_error("The type written to a dynamic buffer is larger than its alignment of " + std::to_string(alignment) + " bytes.");
 	}
-	internalUpload(result, 0);
+	return DynamicBufferWriter<T>(*this, internalBeginWrite(), alignment, getObjectCount());
+}
+
+template<typename T>
+inline void IDynamicBufferResource::upload(const std::vector<T>& data)
+{
+	upload(data, 0);
 }
 
 template<typename T>
 inline void IDynamicBufferResource::upload(const std::vector<T>& data, size_t index)
 {
-	auto alignment = getAlignment();
-	std::vector<char> result(data.size() * alignment);
-	auto size = sizeof(T);
+	if (index > getObjectCount() || data.size() > getObjectCount() - index) {
+		throw std::runtime_error("Uploading " + std::to_string(data.size()) + " objects at index " + std::to_string(index) + " overflows a dynamic buffer of " + std::to_string(getObjectCount()) + " objects.");
+	}
+	auto writer = beginWrite<T>();
+	for (size_t i = 0; i < data.size(); ++i) {
+		memcpy(&writer[index + i], &data[i], sizeof(T));
+	}
+}
 
-	for (auto i = 0, o = 0; i < data.size(); ++i, o += alignment) {
-		memcpy(&result[o], &data[i], sizeof(T));
+template<typename T>
+DynamicBufferWriter<T>::DynamicBufferWriter(IDynamicBufferResource& buffer, char* data, size_t alignment, size_t count)
+	: m_buffer(&buffer)
+	, m_data(data)
+	, m_alignment(alignment)
+	, m_count(count)
+	, m_dirtyBegin(count)
+	, m_dirtyEnd(0)
+{
+}
+
+template<typename T>
+DynamicBufferWriter<T>::DynamicBufferWriter(DynamicBufferWriter&& other) noexcept
+	: m_buffer(other.m_buffer)
+	, m_data(other.m_data)
+	, m_alignment(other.m_alignment)
+	, m_count(other.m_count)
+	, m_dirtyBegin(other.m_dirtyBegin)
+	, m_dirtyEnd(other.m_dirtyEnd)
+{
+	other.m_buffer = nullptr;
+}
+
+template<typename T>
+DynamicBufferWriter<T>::~DynamicBufferWriter()
+{
+	if (m_buffer) {
+		flush();
 	}
+}
 
-	auto offset = alignment * index;
-	
-	internalUpload(result, offset);
+template<typename T>
+void DynamicBufferWriter<T>::flush()
+{
+	if (m_dirtyBegin < m_dirtyEnd) {
+		m_buffer->internalEndWrite(m_dirtyBegin * m_alignment, (m_dirtyEnd - m_dirtyBegin) * m_alignment);
+		m_dirtyBegin = m_count;
+		m_dirtyEnd = 0;
+	}
+}
+
+template<typename T>
+T& DynamicBufferWriter<T>::operator[](size_t index)
+{
+	if (index >= m_count) {
+		throw std::runtime_error("Index " + std::to_string(index) + " is out of range of a dynamic buffer of " + std::to_string(m_count) + " objects.");
+	}
+	m_dirtyBegin = std::min(m_dirtyBegin, index);
+	m_dirtyEnd = std::max(m_dirtyEnd, index + 1);
+	return *reinterpret_cast<T*>(m_data + index * m_alignment);
 }
 
 template<typename T>
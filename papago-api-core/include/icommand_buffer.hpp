@@ -1,6 +1,8 @@
 #pragma once
 #include <functional>
 #include <vector>
+#include <string>
+#include <cstdint>
 
 class IRecordingCommandBuffer;
 class IRecordingSubCommandBuffer;
@@ -12,6 +14,47 @@ class IImageResource;
 class IBufferResource;
 class DynamicBufferResource;
 class IParameterBlock;
+class DynamicSlot;
+
+// GPU time between a pair of timestamps, see IRecorder::beginTimestamp.
+struct GpuTiming {
+	std::string name;
+	double milliseconds;
+};
+
+// Work done by the GPU between a pair of pipeline statistics markers, see IRecorder::beginPipelineStatistics.
+struct PipelineStatistics {
+	std::string name;
+	uint64_t inputAssemblyVertices;
+	uint64_t inputAssemblyPrimitives;
+	uint64_t vertexShaderInvocations;
+	uint64_t clippingInvocations;	//<-- primitives processed by the clipping stage
+	uint64_t clippingPrimitives;	//<-- primitives output by the clipping stage
+	uint64_t fragmentShaderInvocations;
+};
+
+// Binds made while recording, see ICommandBuffer::getBindStatistics.
+struct BindStatistics {
+	uint64_t issued = 0;	//<-- binds recorded into the command buffer
+	uint64_t skipped = 0;	//<-- binds left out, as they would have bound what was already bound
+};
+
+// The arguments of one draw of IRecordingSubCommandBuffer::drawIndirect, as laid out in an indirect buffer.
+struct DrawIndirectCommand {
+	uint32_t vertexCount;
+	uint32_t instanceCount;
+	uint32_t firstVertex;
+	uint32_t firstInstance;
+};
+
+// The arguments of one draw of IRecordingSubCommandBuffer::drawIndexedIndirect.
+struct DrawIndexedIndirectCommand {
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+};
 
 class ICommandBuffer {
 public:
@@ -19,6 +62,15 @@ public:
 	virtual void record(IRenderPass&, ISwapchain&, std::function<void(IRecordingCommandBuffer&)>) = 0;
 	virtual void record(IRenderPass&, IImageResource&, std::function<void(IRecordingCommandBuffer&)>) = 0;
 	virtual void record(IRenderPass&, IImageResource& color, IImageResource& depth, std::function<void(IRecordingCommandBuffer&)>) = 0;
+
+	// The timings of the newest recording whose submission is complete, in the order they were begun. Never waits for
+	// the GPU, so the timings lag a few frames behind the recordings.
+	virtual std::vector<GpuTiming> getTimings() = 0;
+	// Like getTimings, for the pairs of pipeline statistics markers.
+	virtual std::vector<PipelineStatistics> getPipelineStatistics() = 0;
+	// Pipelines, descriptor sets, vertex and index buffers bound by the latest recording. Doesn't include the binds of
+	// the sub command buffers it executes.
+	virtual BindStatistics getBindStatistics() const = 0;
 };
 class ISubCommandBuffer
 {
@@ -26,6 +78,17 @@ public:
 	virtual ~ISubCommandBuffer() = default;
 
 	virtual void record(IRenderPass&, std::function<void(IRecordingSubCommandBuffer&)>) = 0;
+	// Records only if there is no recording for the render pass, or the recording has been invalidated, and returns
+	// whether it recorded. Otherwise the previous recording is executed again, with the same buffers, parameter blocks
+	// and dynamic indices. The content of the buffers may change between executions.
+	virtual bool recordOnce(IRenderPass&, std::function<void(IRecordingSubCommandBuffer&)>) = 0;
+	// Makes the next recordOnce record again. Needed when the commands it would record have changed.
+	virtual void invalidate() = 0;
+
+	// Timings of the newest complete submission of a command buffer executing this one. See ICommandBuffer::getTimings.
+	virtual std::vector<GpuTiming> getTimings() = 0;
+	virtual std::vector<PipelineStatistics> getPipelineStatistics() = 0;
+	virtual BindStatistics getBindStatistics() const = 0;
 };
 
 template<class T>
@@ -35,6 +98,17 @@ public:
 	virtual ~IRecorder() = default;
 
 	virtual T& setDynamicIndex(IParameterBlock& parameterBlock, const std::string& uniformName, size_t) = 0;
+	// Like the above, without looking the uniform up. Meant for setting indices per draw.
+	virtual T& setDynamicIndex(const DynamicSlot&, size_t) = 0;
+
+	// Measures the GPU time of the commands recorded until the matching endTimestamp. Pairs can be nested.
+	// Ignored if the device can't write timestamps on the graphics queue.
+	virtual T& beginTimestamp(const std::string& name) = 0;
+	virtual T& endTimestamp() = 0;
+	// Counts the work done by the GPU for the commands recorded until the matching endPipelineStatistics. Pairs can't be
+	// nested, and a pair in a command buffer can't enclose execute(...). Requires IDevice::Features::pipelineStatisticsQuery.
+	virtual T& beginPipelineStatistics(const std::string& name) = 0;
+	virtual T& endPipelineStatistics() = 0;
 };
 
 class IRecordingCommandBuffer 
@@ -61,7 +135,20 @@ public:
 
 	virtual IRecordingSubCommandBuffer& drawIndexed(size_t indexCount, size_t instanceCount = 1, size_t firstIndex = 0, size_t vertexOffset = 0, size_t firstInstance = 0) = 0;
 	virtual IRecordingSubCommandBuffer& draw(size_t vertexCount, size_t instanceCount = 1, size_t firstVertex = 0, size_t firstInstance = 0) = 0;
+	// Draws drawCount times, with the arguments read from consecutive commands in the buffer, starting offset bytes
+	// into it. The buffer is read when the draws execute, so the arguments can change without recording again.
+	// Buffers must come from IDevice::createIndirectBuffer, and offsets must be multiples of 4.
+	virtual IRecordingSubCommandBuffer& drawIndirect(IBufferResource& commands, size_t drawCount, size_t offset = 0) = 0;
+	virtual IRecordingSubCommandBuffer& drawIndexedIndirect(IBufferResource& commands, size_t drawCount, size_t offset = 0) = 0;
+	// Like the above, with the number of draws read from a uint32_t in countBuffer, and clamped to maxDrawCount.
+	// Requires IDevice::Extensions::drawIndirectCount, and maxDrawCount may not exceed the device's maxDrawIndirectCount.
+	// countBuffer is an indirect buffer too.
+	virtual IRecordingSubCommandBuffer& drawIndirectCount(IBufferResource& commands, size_t offset, IBufferResource& countBuffer, size_t countOffset, size_t maxDrawCount) = 0;
+	virtual IRecordingSubCommandBuffer& drawIndexedIndirectCount(IBufferResource& commands, size_t offset, IBufferResource& countBuffer, size_t countOffset, size_t maxDrawCount) = 0;
 	virtual IRecordingSubCommandBuffer& setVertexBuffer(IBufferResource&) = 0;
+	// Binds the buffers to the vertex buffer bindings 0, 1, ... declared by the vertex shader, e.g. a mesh and a stream
+	// of per instance data. Offsets are in bytes, one per buffer; they are all 0 if none are given.
+	virtual IRecordingSubCommandBuffer& setVertexBuffers(const std::vector<std::reference_wrapper<IBufferResource>>&, const std::vector<size_t>& offsets = {}) = 0;
 	virtual IRecordingSubCommandBuffer& setIndexBuffer(IBufferResource&) = 0;
 	virtual IRecordingSubCommandBuffer& setParameterBlock(IParameterBlock&) = 0;
 };
@@ -1,6 +1,7 @@
 #pragma once
 #include "common.hpp"
 #include "api_enums.hpp"
+#include "igraphics_queue.hpp"
 
 class ISurface;
 enum class Format;
@@ -17,9 +18,50 @@ enum class TextureWrapMode;
 class IGraphicsQueue;
 class ICommandBuffer;
 class ISubCommandBuffer;
+class IFrameGraph;
 class IRenderPass;
 class IParameterBlock;
 struct ParameterBinding;
+class IDevice;
+class TextureFile;
+
+// Returned by IDevice::uploadAsync. Uploads run on a transfer queue when the device has one, so polling
+// a token doesn't stall rendering. A token of 0 refers to an upload that was done right away.
+class UploadToken {
+public:
+	UploadToken() = default;
+
+	bool isComplete() const;
+	void wait() const;
+
+private:
+	UploadToken(IDevice* device, uint64_t id) : m_device(device), m_id(id) {}
+
+	IDevice* m_device = nullptr;
+	uint64_t m_id = 0;
+
+	friend class IDevice;
+};
+
+// Memory use of one heap, see IDevice::getMemoryStatistics. Sizes are in bytes.
+struct MemoryHeapStatistics {
+	uint64_t size = 0;
+	bool deviceLocal = false;
+	uint64_t budget = 0;			//<-- how much the process can allocate from the heap before performance suffers
+	uint64_t usage = 0;				//<-- how much the process has allocated from the heap
+	uint32_t blockCount = 0;		//<-- device memory objects allocated by Papago
+	uint64_t blockBytes = 0;
+	uint32_t allocationCount = 0;	//<-- resources placed in those blocks
+	uint64_t allocationBytes = 0;
+	uint64_t largestFreeBlock = 0;	//<-- largest free range in the blocks, i.e. the largest resource that fits without a new block
+};
+
+struct MemoryStatistics {
+	std::vector<MemoryHeapStatistics> heaps;
+	// With VK_EXT_memory_budget the driver reports budget and usage, including memory allocated outside Papago.
+	// Otherwise usage is the size of Papago's blocks and budget is a fixed share of the heap.
+	bool budgetFromDriver = false;
+};
 
 class IDevice {
 public:
@@ -31,12 +73,29 @@ public:
 	virtual std::unique_ptr<ISwapchain> createSwapChain(Format colorFormat, Format depthStencilFormat, size_t framebufferCount, PresentMode) = 0;
 	
 	template<class T>
-	std::unique_ptr<IBufferResource> createVertexBuffer(std::vector<T> data);
+	std::unique_ptr<IBufferResource> createVertexBuffer(const std::vector<T>& data, BufferMemoryPlacement = BufferMemoryPlacement::eDeviceLocal);
+	template<class T>
+	std::unique_ptr<IBufferResource> createVertexBuffer(const T* data, size_t count, BufferMemoryPlacement = BufferMemoryPlacement::eDeviceLocal);
 	
 	template<class T>
-	std::unique_ptr<IBufferResource> createIndexBuffer(std::vector<T> data);
+	std::unique_ptr<IBufferResource> createIndexBuffer(const std::vector<T>& data, BufferMemoryPlacement = BufferMemoryPlacement::eDeviceLocal);
+	template<class T>
+	std::unique_ptr<IBufferResource> createIndexBuffer(const T* data, size_t count, BufferMemoryPlacement = BufferMemoryPlacement::eDeviceLocal);
 	
 	virtual std::unique_ptr<IBufferResource> createUniformBuffer(size_t size) = 0;
+
+	// Holds the arguments of indirect draws, i.e. DrawIndirectCommands or DrawIndexedIndirectCommands, or the uint32_t
+	// draw counts read by the count variants of the indirect draws.
+	template<class T>
+	std::unique_ptr<IBufferResource> createIndirectBuffer(const std::vector<T>& data, BufferMemoryPlacement = BufferMemoryPlacement::eDeviceLocal);
+
+	// Replaces the content of the resource without waiting for the upload to finish. The resource can be used in
+	// submissions right away, they wait for the upload on the GPU. It must not be in use by the GPU while uploading,
+	// except by the submission passed as after, which the upload waits for. Images must have a single mip level.
+	template<class T>
+	UploadToken uploadAsync(IBufferResource&, const std::vector<T>& data, const SubmissionHandle& after = SubmissionHandle());
+	virtual UploadToken uploadAsync(IImageResource&, const std::vector<char>& data, const SubmissionHandle& after = SubmissionHandle()) = 0;
+
 	virtual std::unique_ptr<ISampler> createTextureSampler1D(
 		Filter magFilter, 
 		Filter minFilter, 
@@ -52,10 +111,14 @@ public:
 		TextureWrapMode modeU,
 		TextureWrapMode modeV,
 		TextureWrapMode modeW) = 0;
-	virtual std::unique_ptr<IImageResource> createTexture2D(size_t width, size_t height, Format) = 0;
+	// A mipLevels of 0 creates the full mip chain. Block compressed textures with several levels must upload each of them.
+	virtual std::unique_ptr<IImageResource> createTexture2D(size_t width, size_t height, Format, uint32_t mipLevels = 1) = 0;
+	// Creates a texture with the format and mip levels stored in the file. The levels are copied as they are, without decoding.
+	virtual std::unique_ptr<IImageResource> createTexture2D(const TextureFile&) = 0;
 	virtual std::unique_ptr<IImageResource> createDepthTexture2D(uint32_t width, uint32_t height, Format) = 0;
 	virtual std::unique_ptr<ICommandBuffer> createCommandBuffer() = 0;
 	virtual std::unique_ptr<ISubCommandBuffer> createSubCommandBuffer() = 0;
+	virtual std::unique_ptr<IFrameGraph> createFrameGraph() = 0;
 	virtual std::unique_ptr<IShaderProgram> createShaderProgram(IVertexShader& vertexShader, IFragmentShader& fragmentShader) = 0;
 	virtual std::unique_ptr<IRenderPass> createRenderPass(IShaderProgram&, uint32_t width, uint32_t height, Format colorFormat) = 0;
 	virtual std::unique_ptr<IRenderPass> createRenderPass(IShaderProgram&, uint32_t width, uint32_t height, Format colorFormat, Format depthStencilFormat) = 0;
@@ -63,49 +126,87 @@ public:
 	virtual std::unique_ptr<IDynamicBufferResource> createDynamicUniformBuffer(size_t object_size, int object_count) = 0;
 	virtual std::unique_ptr<IParameterBlock> createParameterBlock(IRenderPass& renderPass, std::vector<ParameterBinding>& bindings) = 0;
 
-	virtual std::unique_ptr<IGraphicsQueue> createGraphicsQueue() = 0;
+	// present() only waits for the GPU when framesInFlight frames are queued, so the next frame can be recorded meanwhile.
+	// With more than one frame in flight, resources the host writes every frame need a copy per frame, see present().
+	// Command buffers keep a recording per frame in flight, plus the one being recorded, so recording doesn't wait either.
+	virtual std::unique_ptr<IGraphicsQueue> createGraphicsQueue(size_t framesInFlight = 1) = 0;
+
+	virtual MemoryStatistics getMemoryStatistics() const = 0;
 
 	struct Features {
 		bool samplerAnisotropy;
+		bool textureCompressionBC;
+		bool pipelineStatisticsQuery;
+		bool multiDrawIndirect;	//<-- without it, indirect draws of several commands are recorded as one draw per command
 	};
 
 	struct Extensions {
 		bool swapchain;
 		bool samplerMirrorClampToEdge;
+		bool drawIndirectCount;	//<-- VK_KHR_draw_indirect_count, for the indirect draws reading their count from a buffer
 	};
 
 	PAPAGO_API static std::vector<std::unique_ptr<IDevice>> enumerateDevices(ISurface&, const Features&, const Extensions&, bool = false);
 
 protected:
-	virtual std::unique_ptr<IBufferResource> createVertexBufferInternal(std::vector<char>& data) = 0;
-	virtual std::unique_ptr<IBufferResource> createIndexBufferInternal(std::vector<char>& data, BufferResourceElementType) = 0;
+	virtual std::unique_ptr<IBufferResource> createVertexBufferInternal(const void* data, size_t size, BufferMemoryPlacement) = 0;
+	virtual std::unique_ptr<IBufferResource> createIndexBufferInternal(const void* data, size_t size, BufferResourceElementType, BufferMemoryPlacement) = 0;
+	virtual std::unique_ptr<IBufferResource> createIndirectBufferInternal(const void* data, size_t size, BufferMemoryPlacement) = 0;
+	virtual UploadToken uploadAsyncInternal(IBufferResource&, const void* data, size_t size, const SubmissionHandle& after) = 0;
+	virtual bool isUploadComplete(uint64_t id) = 0;
+	virtual void waitUpload(uint64_t id) = 0;
+
+	UploadToken makeUploadToken(uint64_t id) { return UploadToken(this, id); }
+
+	friend class UploadToken;
 };
 
+inline bool UploadToken::isComplete() const {
+	return m_device == nullptr || m_id == 0 || m_device->isUploadComplete(m_id);
+}
+
+inline void UploadToken::wait() const {
+	if (m_device != nullptr && m_id != 0) {
+		m_device->waitUpload(m_id);
+	}
+}
+
+template<class T>
+inline UploadToken IDevice::uploadAsync(IBufferResource& buffer, const std::vector<T>& data, const SubmissionHandle& after) {
+	return uploadAsyncInternal(buffer, data.data(), sizeof(T) * data.size(), after);
+}
+
+template<class T>
+inline std::unique_ptr<IBufferResource> IDevice::createVertexBuffer(const std::vector<T>& vertex_data, BufferMemoryPlacement placement) {
+	return createVertexBuffer(vertex_data.data(), vertex_data.size(), placement);
+}
+
+template<class T>
+inline std::unique_ptr<IBufferResource> IDevice::createVertexBuffer(const T* vertex_data, size_t count, BufferMemoryPlacement placement) {
+	return createVertexBufferInternal(vertex_data, sizeof(T) * count, placement);
+}
+
+template<class T>
+inline std::unique_ptr<IBufferResource> IDevice::createIndirectBuffer(const std::vector<T>& data, BufferMemoryPlacement placement) {
+	return createIndirectBufferInternal(data.data(), sizeof(T) * data.size(), placement);
+}
+
 template<class T>
-inline std::unique_ptr<IBufferResource> IDevice::createVertexBuffer(std::vector<T> vertex_data) {
-	size_t size = sizeof(T) * vertex_data.size();
-	std::vector<char> data(size);
-	memcpy(data.data(), vertex_data.data(), size);
-	return createVertexBufferInternal(data);
+inline std::unique_ptr<IBufferResource> IDevice::createIndexBuffer(const std::vector<T>& index_data, BufferMemoryPlacement placement) {
+	return createIndexBuffer(index_data.data(), index_data.size(), placement);
 }
 
 template<>
-inline std::unique_ptr<IBufferResource> IDevice::createIndexBuffer<uint32_t>(std::vector<uint32_t> index_data) {
-	size_t size = sizeof(uint32_t) * index_data.size();
-	std::vector<char> data(size);
-	memcpy(data.data(), index_data.data(), size);
-	return createIndexBufferInternal(data, BufferResourceElementType::eUint32);
+inline std::unique_ptr<IBufferResource> IDevice::createIndexBuffer<uint32_t>(const uint32_t* index_data, size_t count, BufferMemoryPlacement placement) {
+	return createIndexBufferInternal(index_data, sizeof(uint32_t) * count, BufferResourceElementType::eUint32, placement);
 }
 
 template<> 
-inline std::unique_ptr<IBufferResource> IDevice::createIndexBuffer<uint16_t>(std::vector<uint16_t> index_data) {
-	const auto size = sizeof(uint16_t) * index_data.size();
-	std::vector<char> data(size);
-	memcpy(data.data(), index_data.data(), size);
-	return createIndexBufferInternal(data, BufferResourceElementType::eUint16);
+inline std::unique_ptr<IBufferResource> IDevice::createIndexBuffer<uint16_t>(const uint16_t* index_data, size_t count, BufferMemoryPlacement placement) {
+	return createIndexBufferInternal(index_data, sizeof(uint16_t) * count, BufferResourceElementType::eUint16, placement);
 }
 
 template<class T>
-std::unique_ptr<IBufferResource> IDevice::createIndexBuffer(std::vector<T>) {
+std::unique_ptr<IBufferResource> IDevice::createIndexBuffer(const T*, size_t, BufferMemoryPlacement) {
 	throw std::runtime_error("Only the types uint16 and uint32 can be used in index buffers.");
 }
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "igraphics_queue.hpp"
+
+class IImageResource;
+class IRenderPass;
+class IRecordingCommandBuffer;
+class ISwapchain;
+enum class Format;
+
+// An image used by the passes of one frame graph.
+struct FrameGraphImage {
+	uint32_t index = UINT32_MAX;
+
+	bool isValid() const { return index != UINT32_MAX; }
+};
+
+// Passes declare the images they render to and sample. The graph orders them, places the barriers and layout
+// transitions between them, and records all of them into one command buffer, which is submitted in one go.
+// Passes and images are declared once; the record functions are called again on every execute.
+class IFrameGraph {
+public:
+	virtual ~IFrameGraph() = default;
+
+	// Images owned by the application are in the general layout before and after the graph executes.
+	virtual FrameGraphImage importImage(IImageResource&) = 0;
+	// The image currently acquired from the swapchain. Passes rendering to it also use its depth buffer, if it has one.
+	virtual FrameGraphImage importSwapchain(ISwapchain&) = 0;
+	// Only valid while the graph executes, so images whose passes don't overlap can share memory.
+	// The content doesn't survive from one execute to the next.
+	virtual FrameGraphImage createTransientImage(uint32_t width, uint32_t height, Format) = 0;
+
+	// A pass must not sample its own attachments. Passes writing the same image keep their declared order, and a pass
+	// sampling an image runs after the pass writing it.
+	virtual void addPass(IRenderPass&, FrameGraphImage color, const std::vector<FrameGraphImage>& sampled, std::function<void(IRecordingCommandBuffer&)>) = 0;
+	virtual void addPass(IRenderPass&, FrameGraphImage color, FrameGraphImage depth, const std::vector<FrameGraphImage>& sampled, std::function<void(IRecordingCommandBuffer&)>) = 0;
+
+	// Orders the passes and creates the transient images. Done by the first execute, if it hasn't been done before.
+	// No passes or images can be added afterwards.
+	virtual void compile() = 0;
+	// Transient images can be fetched once the graph is compiled, e.g. to sample them through a parameter block.
+	virtual IImageResource& getImage(FrameGraphImage) = 0;
+	virtual SubmissionHandle execute(IGraphicsQueue&, const std::vector<SubmissionHandle>& waitFor = {}) = 0;
+};
@@ -1,13 +1,61 @@
 #pragma once
+#include <vector>
+#include <functional>
+#include <cstdint>
 class ICommandBuffer;
 class IImageResource;
 class ISwapchain;
+class IGraphicsQueue;
+
+// Returned by IGraphicsQueue::submitCommands. A handle can be polled, waited upon, or passed to later submissions and
+// uploads that must not start before the submission is complete. It must not outlive the queue.
+// A default constructed handle refers to no submission and is always complete.
+class SubmissionHandle {
+public:
+	SubmissionHandle() = default;
+
+	bool isComplete() const;
+	// Returns false if the submission didn't complete within the timeout.
+	bool wait(uint64_t timeoutNanoseconds = UINT64_MAX) const;
+
+private:
+	SubmissionHandle(IGraphicsQueue* queue, uint64_t id) : m_queue(queue), m_id(id) {}
+
+	IGraphicsQueue* m_queue = nullptr;
+	uint64_t m_id = 0;
+
+	friend class IGraphicsQueue;
+	friend class GraphicsQueue;
+	friend class Device;
+};
 
 class IGraphicsQueue
 {
 public:
 	virtual ~IGraphicsQueue() = default;
 
+	// Returns once fewer than framesInFlight frames are queued, see IDevice::createGraphicsQueue. The frames still
+	// queued may be reading any resource they use, so a uniform buffer updated in place right after present() races
+	// them, unless the queue keeps a single frame in flight. Check ISwapchain::needsRecreation afterwards.
 	virtual void present(ISwapchain& swapchain) = 0;
-	virtual void submitCommands(const std::vector<std::reference_wrapper<ICommandBuffer>>&) = 0;
+	// The commands don't start executing before the submissions in waitFor are complete.
+	virtual SubmissionHandle submitCommands(
+		const std::vector<std::reference_wrapper<ICommandBuffer>>&,
+		const std::vector<SubmissionHandle>& waitFor = {}) = 0;
+
+protected:
+	virtual bool isSubmissionComplete(uint64_t id) = 0;
+	virtual bool waitSubmission(uint64_t id, uint64_t timeoutNanoseconds) = 0;
+
+	SubmissionHandle makeSubmissionHandle(uint64_t id) { return SubmissionHandle(this, id); }
+
+	friend class SubmissionHandle;
 };
+
+inline bool SubmissionHandle::isComplete() const {
+	return m_queue == nullptr || m_id == 0 || m_queue->isSubmissionComplete(m_id);
+}
+
+inline bool SubmissionHandle::wait(uint64_t timeoutNanoseconds) const {
+	return m_queue == nullptr || m_id == 0 || m_queue->waitSubmission(m_id, timeoutNanoseconds);
+}
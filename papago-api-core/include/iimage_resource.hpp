@@ -7,9 +7,13 @@ public:
 	virtual ~IImageResource() = default;
 
 	virtual std::vector<char> download() = 0;
+	// Uploads the first mip level and generates the rest of the chain from it. Throws if the image has several levels
+	// and its format can't be blitted, e.g. block compressed formats, which need every level uploaded by mip level.
 	virtual void upload(const std::vector<char>& data) = 0;
+	virtual void upload(const std::vector<char>& data, uint32_t mipLevel) = 0;
 	virtual bool inUse() = 0;
 	virtual Format getFormat() const = 0;
 	virtual uint32_t getWidth() const = 0;
 	virtual uint32_t getHeight() const = 0;
+	virtual uint32_t getMipLevels() const = 0;
 };
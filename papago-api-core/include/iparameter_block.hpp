@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <cstdint>
 class IBufferResource;
 class IDynamicBufferResource;
 class IImageResource;
@@ -12,9 +13,32 @@ enum class BindingType
   eCombinedImageSampler 
 }; 
 
+class IParameterBlock;
+
+// A dynamic uniform of a parameter block, resolved by IParameterBlock::dynamicSlot. Lets setDynamicIndex skip the
+// lookups by name on every draw. Valid as long as the parameter block is.
+class DynamicSlot {
+public:
+	DynamicSlot() = default;
+
+private:
+	DynamicSlot(IParameterBlock* parameterBlock, uint32_t binding, uint32_t alignment)
+		: m_parameterBlock(parameterBlock), m_binding(binding), m_alignment(alignment) {}
+
+	IParameterBlock* m_parameterBlock = nullptr;
+	uint32_t m_binding = 0;
+	uint32_t m_alignment = 0;
+
+	friend class ParameterBlock;
+	template<class T> friend class CommandRecorder;
+};
+
 class IParameterBlock {
 public:
 	virtual ~IParameterBlock() = default;
+
+	// The uniform must be bound to a dynamic buffer resource.
+	virtual DynamicSlot dynamicSlot(const std::string& uniformName) = 0;
 };
 
 struct ParameterBinding {
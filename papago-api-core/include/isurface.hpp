@@ -8,7 +8,12 @@ public:
 	size_t getWidth() const { return m_width; }
 	size_t getHeight() const { return m_height; }
 
+#ifdef _WIN32
 	PAPAGO_API static std::unique_ptr<ISurface> createWin32Surface(size_t width, size_t height, HWND);
+#endif
+	// Renders without a window. Devices created with it have no swapchain extension, and their swapchains are a ring
+	// of offscreen images of the surface's size, which IGraphicsQueue::present rotates through.
+	PAPAGO_API static std::unique_ptr<ISurface> createHeadlessSurface(size_t width, size_t height);
 
 protected:
 	ISurface(size_t width, size_t height) : m_width(width), m_height(height) { }
@@ -9,6 +9,10 @@ public:
 	virtual uint32_t getWidth() const = 0;
 	virtual uint32_t getHeight() const = 0;
 	virtual Format getFormat() const = 0;
+	// Set by IGraphicsQueue::present once the presentation engine reports the swapchain as suboptimal or out of date,
+	// e.g. after the window was resized. The swapchain should be replaced by a new one before rendering the next frame,
+	// an out of date swapchain can't be presented to anymore.
+	virtual bool needsRecreation() const = 0;
 
 	enum class PresentMode {
 		eMailbox
@@ -4,6 +4,7 @@
 #include "ibuffer_resource.hpp"
 #include "icommand_buffer.hpp"
 #include "idevice.hpp"
+#include "iframe_graph.hpp"
 #include "igraphics_queue.hpp"
 #include "iimage_resource.hpp"
 #include "irender_pass.hpp"
@@ -13,4 +14,5 @@
 #include "isurface.hpp"
 #include "iswapchain.hpp"
 #include "parser.hpp"
+#include "texture_file.hpp"
 #include "iparameter_block.hpp"
\ No newline at end of file
@@ -13,6 +13,13 @@ class PAPAGO_API Parser
 {
 public:
 	Parser(const std::string& compilerPath);
+	/*
+	 * Inputs are read from vertex buffer binding 0, per vertex, unless a comment after the input names another binding.
+	 * Adding "instance" makes the binding advance per instance, e.g.
+	 *     layout(location = 2) in mat4 model; // binding = 1, instance
+	 * The inputs of a binding are packed in the order of their locations, unused locations are skipped.
+	 * IDevice::createShaderProgram checks the bindings and locations against the device's limits.
+	 */
 	std::unique_ptr<IVertexShader> compileVertexShader(const std::string& source, const std::string& entryPoint);
 	std::unique_ptr<IFragmentShader> compileFragmentShader(const std::string& source, const std::string& entryPoint);
 private:
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "api_enums.hpp"
+
+// A texture read from a .dds or .ktx2 file. The mip levels are kept exactly as they are stored in the file,
+// so block compressed textures can be uploaded without being decoded. See IDevice::createTexture2D.
+class PAPAGO_API TextureFile
+{
+public:
+	TextureFile(const std::string& path);
+
+	Format getFormat() const { return m_format; }
+	uint32_t getWidth() const { return m_width; }
+	uint32_t getHeight() const { return m_height; }
+	uint32_t getMipLevels() const { return static_cast<uint32_t>(m_levels.size()); }
+
+	const char* getLevelData(uint32_t mipLevel) const;
+	size_t getLevelSize(uint32_t mipLevel) const;
+
+private:
+	struct Level
+	{
+		size_t offset;
+		size_t size;
+	};
+
+	void parseDds();
+	void parseKtx2();
+	// Levels stored back to back from offset, as in .dds files.
+	void addPackedLevels(size_t offset, uint32_t levelCount);
+	size_t getLevelSizeFromFormat(uint32_t mipLevel) const;
+
+	std::vector<char> m_data;
+	Format m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	std::vector<Level> m_levels;
+};
@@ -1,5 +1,5 @@
 #include "standard_header.hpp"
-#include "..\include\api_enums.hpp"
+#include "../include/api_enums.hpp"
 
 DepthStencilFlags operator&(DepthStencilFlags lhs, DepthStencilFlags rhs)
 {
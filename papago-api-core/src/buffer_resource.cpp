@@ -1,77 +1,155 @@
 #include "standard_header.hpp"
 #include "buffer_resource.hpp"
+#include "submission_pool.hpp"
+#include "staging_ring.hpp"
 
 BufferResource::BufferResource(BufferResource&& other) noexcept
 	: Resource(std::move(other))
 	, m_vkBuffer(std::move(other.m_vkBuffer))
+	, m_vkUsage(other.m_vkUsage)
 	, m_elementType(other.m_elementType)
+	, m_vkInfo(other.m_vkInfo)
+	, m_stagingRing(other.m_stagingRing)
+	, m_mapped(other.m_mapped)
+	, m_hostCoherent(other.m_hostCoherent)
+	, m_mapScratch(std::move(other.m_mapScratch))
 {
+	other.m_mapped = nullptr;
 }
 
-void BufferResource::upload(const std::vector<char>& data, size_t offset)
+BufferResource::~BufferResource()
 {
-	auto mappedMemory = m_vkDevice->mapMemory(*m_vkMemory, offset, data.size());
-	memcpy(mappedMemory, data.data(), data.size());
-	m_vkDevice->unmapMemory(*m_vkMemory);
+	if (m_mapped) {
+		m_allocator->unmap(m_memory);
+	}
+}
+
+void BufferResource::upload(const void* data, size_t size, size_t offset)
+{
+	if (offset + size > m_vkInfo.range) {
+		PAPAGO_ERROR("Upload of " + std::to_string(size) + " bytes at offset " + std::to_string(offset) 
+			+ " exceeds the buffer size of " + std::to_string(m_vkInfo.range) + " bytes");
+	}
+
+	if (m_stagingRing) {
+		m_stagingRing->copyToBuffer(data, size, *m_vkBuffer, offset);
+		return;
+	}
+
+	memcpy(m_mapped + offset, data, size);
+	flush(offset, size);
+}
+
+// Makes host writes to the mapped memory visible to the device. Only needed for non-coherent memory.
+void BufferResource::flush(size_t offset, size_t size)
+{
+	if (!m_hostCoherent) {
+		m_allocator->flush(m_memory, offset, size);
+	}
 }
 
 inline bool BufferResource::inUse()
 {
-	return m_vkFence
-		&& m_vkDevice->getFenceStatus(*m_vkFence) == vk::Result::eNotReady;
+	return m_submissionPool
+		&& !m_submissionPool->isComplete(m_lastSubmission);
 }
 
-void BufferResource::internalUpload(const std::vector<char>& data)
+void BufferResource::internalUpload(const void* data, size_t size, size_t offset)
 {
-	auto mappedMemory = m_vkDevice->mapMemory(*m_vkMemory, 0, data.size());
-	memcpy(mappedMemory, data.data(), data.size());
-	m_vkDevice->unmapMemory(*m_vkMemory);
+	upload(data, size, offset);
 }
 
 std::vector<char> BufferResource::internalDownload()
 {
+	if (m_stagingRing) {
+		std::vector<char> result(m_vkInfo.range);
+		m_stagingRing->copyFromBuffer(*m_vkBuffer, 0, result.size(), result.data());
+		return result;
+	}
+
 	std::vector<char> result(m_size);
-	auto mappedMemory = m_vkDevice->mapMemory(*m_vkMemory, 0, VK_WHOLE_SIZE);
-	memcpy(result.data(), mappedMemory, m_size);
-	m_vkDevice->unmapMemory(*m_vkMemory);
+	if (!m_hostCoherent) {
+		m_allocator->invalidate(m_memory, 0, m_size);
+	}
+	memcpy(result.data(), m_mapped, m_size);
 	return result;
 }
 
+void* BufferResource::internalMap()
+{
+	if (m_mapped) {
+		return m_mapped;
+	}
+
+	// The whole scratch is uploaded on unmap, so it starts out with the buffer's content, which the caller may only
+	// change in part.
+	m_mapScratch.resize(m_vkInfo.range);
+	m_stagingRing->copyFromBuffer(*m_vkBuffer, 0, m_mapScratch.size(), m_mapScratch.data());
+	return m_mapScratch.data();
+}
+
+void BufferResource::internalUnmap()
+{
+	if (m_mapped) {
+		flush(0, m_vkInfo.range);
+		return;
+	}
+
+	upload(m_mapScratch.data(), m_mapScratch.size());
+}
+
+size_t BufferResource::getSize() const
+{
+	return m_vkInfo.range;
+}
+
 std::unique_ptr<BufferResource> BufferResource::createBufferResource(
-	vk::PhysicalDevice			physicalDevice, 
+	MemoryAllocator&			allocator, 
 	const vk::UniqueDevice&		device, 
 	size_t						size, 
 	vk::BufferUsageFlags		usageFlags, 
 	vk::MemoryPropertyFlags		memoryFlags,
-	BufferResourceElementType	type)
+	BufferResourceElementType	type,
+	StagingRing*				stagingRing)
 {
+	usageFlags |= vk::BufferUsageFlagBits::eTransferDst; //IMPROVEMENT: All buffers are currently assumed to be able to be uploaded to
 	auto bufferCreateInfo = vk::BufferCreateInfo()
 		.setSize(size)
-		.setUsage(usageFlags | vk::BufferUsageFlagBits::eTransferDst); //IMPROVEMENT: All buffers are currently assumed to be able to be uploaded to
+		.setUsage(usageFlags);
 
 	auto vkBuffer = device->createBufferUnique(bufferCreateInfo); 
 
 	auto memoryRequirements = device->getBufferMemoryRequirements(*vkBuffer);
 
-	return std::make_unique<BufferResource>(device, physicalDevice, std::move(vkBuffer), memoryFlags, memoryRequirements, size);
+	return std::make_unique<BufferResource>(device, allocator, std::move(vkBuffer), usageFlags, memoryFlags, memoryRequirements, size, type, stagingRing);
 }
 
 BufferResource::BufferResource(
 	const vk::UniqueDevice&				device,
-	const vk::PhysicalDevice&			physicalDevice,
+	MemoryAllocator&					allocator,
 	vk::UniqueBuffer&&					buffer,
+	vk::BufferUsageFlags				usageFlags,
 	vk::MemoryPropertyFlags				memoryFlags,
 	vk::MemoryRequirements				memoryRequirements,
 	size_t								range,
-	const BufferResourceElementType		type)
-		: Resource(physicalDevice, device, memoryFlags, memoryRequirements)
+	const BufferResourceElementType		type,
+	StagingRing*						stagingRing)
+		: Resource(allocator, device, memoryFlags, memoryRequirements, AllocationKind::eBuffer)
 		, m_vkBuffer(std::move(buffer))
+		, m_vkUsage(usageFlags)
 		, m_elementType(type)
+		, m_stagingRing(memoryFlags & vk::MemoryPropertyFlagBits::eHostVisible ? nullptr : stagingRing)
+		, m_mapped(nullptr)
+		, m_hostCoherent(m_allocator->isCoherent(m_memory))
 {
 	m_vkInfo.setBuffer(*m_vkBuffer)
 		.setOffset(0)
 		.setRange(range); 
-	device->bindBufferMemory(*m_vkBuffer, *m_vkMemory, 0);
+	device->bindBufferMemory(*m_vkBuffer, m_memory.memory, m_memory.offset);
+
+	if (memoryFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+		m_mapped = static_cast<char*>(m_allocator->map(m_memory));
+	}
 }
 
 
@@ -80,13 +158,22 @@ std::vector<char> DynamicBufferResource::internalDownload()
 	return m_buffer->download();
 }
 
-void DynamicBufferResource::internalUpload(const std::vector<char>& data, size_t offset)
+char* DynamicBufferResource::internalBeginWrite()
 {
-	auto& internalBuffer = dynamic_cast<BufferResource&>(*m_buffer);
-	internalBuffer.upload(data, offset);
+	return dynamic_cast<BufferResource&>(*m_buffer).m_mapped;
+}
+
+void DynamicBufferResource::internalEndWrite(size_t offset, size_t size)
+{
+	dynamic_cast<BufferResource&>(*m_buffer).flush(offset, size);
 }
 
 size_t DynamicBufferResource::getAlignment()
 {
 	return m_alignment;
 }
+
+size_t DynamicBufferResource::getObjectCount()
+{
+	return m_objectCount;
+}
@@ -1,9 +1,10 @@
 #pragma once
-#include "vulkan\vulkan.hpp"
+#include "vulkan/vulkan.hpp"
 #include "resource.hpp"
 #include "ibuffer_resource.hpp"
 #include "device.hpp"
 
+class StagingRing;
 
 
 class BufferResource : public Resource, public IBufferResource
@@ -12,34 +13,47 @@ public:
 
 	BufferResource(
 		const vk::UniqueDevice&		device,
-		const vk::PhysicalDevice&	physicalDevice,
+		MemoryAllocator&			allocator,
 		vk::UniqueBuffer&&			buffer,
+		vk::BufferUsageFlags		usageFlags,
 		vk::MemoryPropertyFlags		memoryFlags,
 		vk::MemoryRequirements		memoryRequirements,
 		size_t						range,
-		BufferResourceElementType	type = BufferResourceElementType::eChar);
+		BufferResourceElementType	type = BufferResourceElementType::eChar,
+		StagingRing*				stagingRing = nullptr);
 	BufferResource(const BufferResource&) = delete;
 	BufferResource(BufferResource&& other) noexcept;
+	~BufferResource();
 
-	void upload(const std::vector<char>& data, size_t offset = 0);
+	void upload(const void* data, size_t size, size_t offset = 0);
+	void flush(size_t offset, size_t size);
 
 	// Inherited via Resource
 	bool inUse() override;
 	const BufferResourceElementType m_elementType;
 	vk::UniqueBuffer m_vkBuffer;
+	vk::BufferUsageFlags m_vkUsage;	//<-- the usage the buffer was created with, checked where it is bound
 	vk::DescriptorBufferInfo m_vkInfo;
+	StagingRing* m_stagingRing;	//<-- only set for buffers that are not host visible
+	char* m_mapped;				//<-- host visible buffers stay mapped for their entire lifetime
+	bool m_hostCoherent;
+	std::vector<char> m_mapScratch;	//<-- backs map() of buffers that are not host visible
 
 	static std::unique_ptr<BufferResource> createBufferResource(
-		vk::PhysicalDevice			physicalDevice,
+		MemoryAllocator&			allocator,
 		const vk::UniqueDevice&		device,
 		size_t						size,
 		vk::BufferUsageFlags		usageFlags,
 		vk::MemoryPropertyFlags		memoryFlags,
-		BufferResourceElementType	type = BufferResourceElementType::eChar);
+		BufferResourceElementType	type = BufferResourceElementType::eChar,
+		StagingRing*				stagingRing = nullptr);
 
 protected:
-	void internalUpload(const std::vector<char>& data) override;
+	void internalUpload(const void* data, size_t size, size_t offset) override;
 	std::vector<char> internalDownload() override;
+	void* internalMap() override;
+	void internalUnmap() override;
+	size_t getSize() const override;
 private:
 
 };
@@ -61,8 +75,10 @@ public:
 
 	// Inherited via IDynamicBuffer
 	std::vector<char> internalDownload() override;
-	void internalUpload(const std::vector<char>&, size_t offset=0) override;
+	char* internalBeginWrite() override;
+	void internalEndWrite(size_t offset, size_t size) override;
 	size_t getAlignment() override;
+	size_t getObjectCount() override;
 };
 
 //TODO: move to buffer_resource.cpp?
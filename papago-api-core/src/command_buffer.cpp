@@ -17,6 +17,10 @@ CommandBuffer::operator vk::CommandBuffer&()
 IRecordingCommandBuffer & CommandBuffer::execute(const std::vector<std::reference_wrapper<ISubCommandBuffer>>& subCommands)
 {
 	//TODO: check subCommands to see if they are ready to be executed? -AM
+	// The render pass is restarted below, and a query can't span several render pass instances.
+	if (m_isCountingStatistics) {
+		PAPAGO_ERROR("execute(...) called while pipeline statistics are being counted; count them in the sub command buffers instead");
+	}
 
 	auto secondaryCommandBuffers = std::vector<vk::CommandBuffer>();
 	secondaryCommandBuffers.reserve(subCommands.size());
@@ -27,10 +31,22 @@ IRecordingCommandBuffer & CommandBuffer::execute(const std::vector<std::referenc
 	}
 	
 	m_vkCommandBuffer->endRenderPass();
+	// Sub command buffers are recorded inside a render pass, so their queries are reset by the command buffer executing them.
+	for (auto& isub : subCommands) {
+		auto& internalSub = dynamic_cast<SubCommandBuffer&>(isub.get());
+		internalSub.recordQueryReset(*m_vkCommandBuffer);
+		m_subCommandBuffersInUse.push_back(&internalSub);
+	}
 	m_vkCommandBuffer->beginRenderPass(m_vkRenderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
 
 	m_vkCommandBuffer->executeCommands(secondaryCommandBuffers);
+	for (auto& isub : subCommands) {
+		auto& internalSub = dynamic_cast<SubCommandBuffer&>(isub.get());
+		m_resourcesInUse.insert(m_resourcesInUse.end(), ITERATE(internalSub.m_resourcesInUse));
+	}
 	m_boundDescriptorBindings.clear();
+	// The state bound by the primary command buffer is undefined after executing secondaries.
+	resetBoundState();
 
 	m_vkCommandBuffer->endRenderPass();
 	m_vkCommandBuffer->beginRenderPass(m_vkRenderPassBeginInfo, vk::SubpassContents::eInline);
@@ -38,27 +54,20 @@ IRecordingCommandBuffer & CommandBuffer::execute(const std::vector<std::referenc
 	return *this;
 }
 
-CommandBuffer::CommandBuffer(const vk::UniqueDevice &device, int queueFamilyIndex)
-	: CommandRecorder<IRecordingCommandBuffer>(device), m_queueFamilyIndex(queueFamilyIndex)
+CommandBuffer::CommandBuffer(const vk::UniqueDevice &device, int queueFamilyIndex, const DeviceCapabilities& capabilities)
+	: CommandRecorder<IRecordingCommandBuffer>(device, capabilities), m_queueFamilyIndex(queueFamilyIndex)
 {
-	vk::CommandPoolCreateInfo poolCreateInfo = {};
-	poolCreateInfo.setQueueFamilyIndex(queueFamilyIndex)
-		.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
-
-	m_vkCommandPool = device->createCommandPoolUnique(poolCreateInfo);
-
-	vk::CommandBufferAllocateInfo allocateInfo = {};
-	allocateInfo.setCommandBufferCount(1)	//TODO: find good way to make setable. -AM
-		.setCommandPool(*m_vkCommandPool)
-		.setLevel(vk::CommandBufferLevel::ePrimary);
-
-	m_vkCommandBuffer = std::move(device->allocateCommandBuffersUnique(allocateInfo)[0]);
+	createCommandFrames(queueFamilyIndex, vk::CommandBufferLevel::ePrimary);
 }
 
 void CommandBuffer::record(IRenderPass & renderPass, ISwapchain & swapchain, std::function<void(IRecordingCommandBuffer&)> func)
 {
 	auto& internalSwapChain = static_cast<SwapChain&>(swapchain);
 	begin(static_cast<RenderPass&>(renderPass), internalSwapChain.m_vkFramebuffers[internalSwapChain.m_currentFramebufferIndex], { swapchain.getWidth(), swapchain.getHeight() });
+	m_resourcesInUse.push_back(&internalSwapChain.m_colorResources[internalSwapChain.m_currentFramebufferIndex]);
+	if (!internalSwapChain.m_depthResources.empty()) {
+		m_resourcesInUse.push_back(&internalSwapChain.m_depthResources[internalSwapChain.m_currentFramebufferIndex]);
+	}
 	func(*this);
 	end();
 }
@@ -68,6 +77,23 @@ CommandBuffer::CommandBuffer(CommandBuffer &&other)
 {
 }
 
+std::vector<GpuTiming> CommandBuffer::getTimings()
+{
+	resolveQueries();
+	return m_timings;
+}
+
+std::vector<PipelineStatistics> CommandBuffer::getPipelineStatistics()
+{
+	resolveQueries();
+	return m_pipelineStatistics;
+}
+
+BindStatistics CommandBuffer::getBindStatistics() const
+{
+	return m_bindStatistics;
+}
+
 
 void CommandBuffer::record(IRenderPass & renderPass, IImageResource & target, std::function<void(IRecordingCommandBuffer&)> func)
 {
@@ -75,7 +101,7 @@ void CommandBuffer::record(IRenderPass & renderPass, IImageResource & target, st
 	auto& internalRenderPass = static_cast<RenderPass&>(renderPass);
 	auto extent = internalColor.m_vkExtent;
 
-	vk::ImageView attachments[1] = { *internalColor.m_vkImageView };
+	vk::ImageView attachments[1] = { internalColor.getAttachmentView() };
 
 	vk::FramebufferCreateInfo fboCreate;
 	fboCreate.setAttachmentCount(1)
@@ -89,6 +115,7 @@ void CommandBuffer::record(IRenderPass & renderPass, IImageResource & target, st
 	internalColor.m_vkFramebuffer = m_vkDevice->createFramebufferUnique(fboCreate);
 
 	begin(internalRenderPass, internalColor.m_vkFramebuffer, { extent.width, extent.height });
+	m_resourcesInUse.push_back(&internalColor);
 	func(*this);
 	end();
 }
@@ -99,7 +126,7 @@ void CommandBuffer::record(IRenderPass& renderPass, IImageResource& color, IImag
 	auto& internalDepth = static_cast<ImageResource&>(depth);
 	auto& internalRenderPass = static_cast<RenderPass&>(renderPass);
 	auto extent = internalColor.m_vkExtent;
-	vk::ImageView attachments[2] = { *internalColor.m_vkImageView, *internalDepth.m_vkImageView };
+	vk::ImageView attachments[2] = { internalColor.getAttachmentView(), internalDepth.getAttachmentView() };
 
 	vk::FramebufferCreateInfo fboCreate;
 	fboCreate.setAttachmentCount(2)
@@ -112,11 +139,47 @@ void CommandBuffer::record(IRenderPass& renderPass, IImageResource& color, IImag
 	internalColor.m_vkFramebuffer = m_vkDevice->createFramebufferUnique(fboCreate);
 
 	begin(internalRenderPass, internalColor.m_vkFramebuffer, { extent.width, extent.height });
+	m_resourcesInUse.push_back(&internalColor);
+	m_resourcesInUse.push_back(&internalDepth);
 	func(*this);
 	end();
 }
 
 void CommandBuffer::begin(RenderPass& renderPass, const vk::UniqueFramebuffer& renderTarget, vk::Extent2D extent)
+{
+	beginCommands();
+	beginPass(renderPass, static_cast<vk::RenderPass>(renderPass), *renderTarget, extent);
+}
+
+void CommandBuffer::end()
+{
+	endPass();
+	endCommands();
+}
+
+void CommandBuffer::beginCommands()
+{
+	vk::CommandBufferBeginInfo beginInfo = {};
+	beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);	//TODO: read from Usage in constructor? -AM
+
+	beginQueries();
+	beginCommandFrame();
+	m_vkCommandBuffer->begin(beginInfo);
+	recordQueryReset(*m_vkCommandBuffer);
+	m_resourcesInUse.clear();
+	m_subCommandBuffersInUse.clear();
+	m_bindStatistics = {};
+}
+
+void CommandBuffer::endCommands()
+{
+	endQueries();
+	m_vkCommandBuffer->end();
+	removeDuplicateResources();
+}
+
+// vkRenderPass may be a render pass compatible with renderPass, which only differs in the layouts of its attachments.
+void CommandBuffer::beginPass(RenderPass& renderPass, vk::RenderPass vkRenderPass, vk::Framebuffer renderTarget, vk::Extent2D extent)
 {
 	m_renderPassPtr = &renderPass;
 	m_vkCurrentRenderTargetExtent = extent;
@@ -126,30 +189,26 @@ void CommandBuffer::begin(RenderPass& renderPass, const vk::UniqueFramebuffer& r
 		.setExtent(extent);
 
 	m_vkRenderPassBeginInfo = {};
-	m_vkRenderPassBeginInfo.setRenderPass(static_cast<vk::RenderPass>(renderPass))
-		.setFramebuffer(*renderTarget)
+	m_vkRenderPassBeginInfo.setRenderPass(vkRenderPass)
+		.setFramebuffer(renderTarget)
 		.setRenderArea(renderArea)
 		.setClearValueCount(0)
 		.setPClearValues(nullptr);
 
-	vk::CommandBufferBeginInfo beginInfo = {};
-	beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);	//TODO: read from Usage in constructor? -AM
-
-	m_vkCommandBuffer->begin(beginInfo);
 	m_vkCommandBuffer->beginRenderPass(m_vkRenderPassBeginInfo, vk::SubpassContents::eInline);
+	resetBoundState();
 
 	if (m_renderPassPtr->m_shaderProgram.getUniqueUniformBindings().empty()) {
-		m_vkCommandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *m_renderPassPtr->getPipeline(0));
+		bindPipeline(*m_renderPassPtr->getPipeline(0));
 	}
 }
 
-void CommandBuffer::end()
+void CommandBuffer::endPass()
 {
 	m_renderPassPtr = nullptr;
 	m_vkRenderPassBeginInfo = {};
 	m_vkCurrentRenderTargetExtent = vk::Extent2D();
 	m_vkCommandBuffer->endRenderPass();
-	m_vkCommandBuffer->end();
 }
 
 void CommandBuffer::drawInstanced(size_t instanceVertexCount, size_t instanceCount, size_t startVertexLocation, size_t startInstanceLocation)
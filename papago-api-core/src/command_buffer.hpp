@@ -9,18 +9,28 @@ class ImageResource;
 class CommandBuffer : public CommandRecorder<IRecordingCommandBuffer>, public ICommandBuffer
 {
 public:
-	CommandBuffer(const vk::UniqueDevice& device, int queueFamilyIndex);
+	CommandBuffer(const vk::UniqueDevice& device, int queueFamilyIndex, const DeviceCapabilities& = DeviceCapabilities());
 	CommandBuffer(CommandBuffer&&);
 
 	void record(IRenderPass&, ISwapchain&, std::function<void(IRecordingCommandBuffer&)>) override;
 	void record(IRenderPass&, IImageResource&, std::function<void(IRecordingCommandBuffer&)>) override;
 	void record(IRenderPass &, IImageResource & color, IImageResource & depth, std::function<void(IRecordingCommandBuffer&)>) override;
 
+	std::vector<GpuTiming> getTimings() override;
+	std::vector<PipelineStatistics> getPipelineStatistics() override;
+	BindStatistics getBindStatistics() const override;
+
 	IRecordingCommandBuffer& execute(const std::vector<std::reference_wrapper<ISubCommandBuffer>>&) override;
 
 	void begin(RenderPass&, const vk::UniqueFramebuffer&, vk::Extent2D);	//TODO: <-- remove imageIndex. -AM
 	void end();
 
+	// Lets several render passes, and the barriers between them, be recorded into the command buffer.
+	void beginCommands();
+	void endCommands();
+	void beginPass(RenderPass&, vk::RenderPass, vk::Framebuffer, vk::Extent2D);
+	void endPass();
+
 	void drawInstanced(size_t instanceVertexCount, size_t instanceCount, size_t startVertexLocation, size_t startInstanceLocation);
 
 	IRecordingCommandBuffer& clearColorBuffer(float red, float green, float blue, float alpha) override;
@@ -39,6 +49,7 @@ public:
 	}
 
 	std::vector<uint32_t> m_boundDescriptorBindings; 
+	std::vector<CommandRecorder<IRecordingSubCommandBuffer>*> m_subCommandBuffersInUse;	//<-- their timestamps are written by this command buffer's submissions
 private:
 	uint32_t m_queueFamilyIndex;
 	void clearAttachment(const vk::ClearValue &, vk::ImageAspectFlags);
@@ -1,5 +1,6 @@
 #include "standard_header.hpp"
 #include <set>
+#include <map>
 #include "command_buffer.hpp"
 #include "sub_command_buffer.hpp"
 #include "surface.hpp"
@@ -14,23 +15,33 @@
 #include "shader_program.hpp"
 #include "buffer_resource.hpp"
 #include "parameter_block.hpp"
+#include "texture_file.hpp"
+#include "frame_graph.hpp"
 
 std::vector<std::unique_ptr<IDevice>> IDevice::enumerateDevices(ISurface & surface, const Features & features, const Extensions & extensions, bool preferSplitQueue)
 {
 	// TODO: Support more features and extensions
 	vk::PhysicalDeviceFeatures vkFeatures = {};
 	vkFeatures.samplerAnisotropy = features.samplerAnisotropy;
+	vkFeatures.textureCompressionBC = features.textureCompressionBC;
+	vkFeatures.pipelineStatisticsQuery = features.pipelineStatisticsQuery;
+	vkFeatures.multiDrawIndirect = features.multiDrawIndirect;
 
 	std::vector<const char *> vkExtensions;
 	if (extensions.samplerMirrorClampToEdge) {
 		vkExtensions.push_back(VK_KHR_SAMPLER_MIRROR_CLAMP_TO_EDGE_EXTENSION_NAME);
 	}
-	if (extensions.swapchain) {
+	if (extensions.drawIndirectCount) {
+		vkExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+	// Headless devices have nothing to present to, their swapchains are offscreen.
+	auto& internalSurface = (Surface&)surface;
+	if (extensions.swapchain && !internalSurface.isHeadless()) {
 		// Should this be forced on by default ?? - CW 2018-04-18
 		vkExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 	}
 
-	auto devices = Device::enumerateDevices((Surface&)surface, vkFeatures, vkExtensions, preferSplitQueue);
+	auto devices = Device::enumerateDevices(internalSurface, vkFeatures, vkExtensions, preferSplitQueue);
 	std::vector<std::unique_ptr<IDevice>> result;
 	result.reserve(devices.size());
 	for (auto& device : devices) {
@@ -48,25 +59,57 @@ std::vector<Device> Device::enumerateDevices(Surface& surface, const vk::Physica
 #endif 
 
 	std::vector<Device> result;
-	const float queuePriority = 1.0f;
+	const float queuePriorities[] = { 1.0f, 0.5f };	//<-- a second queue in the graphics family is only used for streaming
 	for (auto& physicalDevice : surface.m_vkInstance->enumeratePhysicalDevices()) {
 		if (! isPhysicalDeviceSuitable(physicalDevice, surface, extensions, preferSplitQueue)) {
 			continue;
 		}
 
 		auto queueFamilyIndicies = findQueueFamilies(physicalDevice, surface, preferSplitQueue);
-		auto queueCreateInfos = createQueueCreateInfos(queueFamilyIndicies, queuePriority);
+		auto queueCreateInfos = createQueueCreateInfos(queueFamilyIndicies, queuePriorities);
+
+		DeviceCapabilities capabilities;
+
+		// Enabled whenever it is supported, for getMemoryStatistics
+		auto deviceExtensions = extensions;
+		capabilities.memoryBudget = surface.m_hasPhysicalDeviceProperties2 && areExtensionsSupported(physicalDevice, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME });
+		if (capabilities.memoryBudget) {
+			deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+
+		// Enabled whenever it is supported, so graphics queues can track their submissions with a single semaphore
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+		timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
+		capabilities.timelineSemaphore = isTimelineSemaphoreSupported(physicalDevice, surface);
+		if (capabilities.timelineSemaphore) {
+			deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		}
 
 		auto logicalDevice = physicalDevice.createDeviceUnique(vk::DeviceCreateInfo()
-			.setEnabledExtensionCount(extensions.size())
-			.setPpEnabledExtensionNames(extensions.data())
+			.setPNext(capabilities.timelineSemaphore ? &timelineSemaphoreFeatures : nullptr)
+			.setEnabledExtensionCount(deviceExtensions.size())
+			.setPpEnabledExtensionNames(deviceExtensions.data())
 			.setPEnabledFeatures(&features)
 			.setEnabledLayerCount(enabledLayers.size())
 			.setPpEnabledLayerNames(enabledLayers.data())
 			.setQueueCreateInfoCount(queueCreateInfos.size())
 			.setPQueueCreateInfos(queueCreateInfos.data()));
 
-		result.emplace_back(physicalDevice, logicalDevice, surface, preferSplitQueue);
+		capabilities.pipelineStatistics = features.pipelineStatisticsQuery == VK_TRUE;
+		capabilities.multiDrawIndirect = features.multiDrawIndirect == VK_TRUE;
+		capabilities.drawIndirectCount = std::any_of(ITERATE(extensions), [](const char* name) {
+			return std::string(name) == VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+		});
+		capabilities.textureCompressionBC = features.textureCompressionBC == VK_TRUE;
+
+		auto limits = physicalDevice.getProperties().limits;
+		capabilities.maxDrawIndirectCount = limits.maxDrawIndirectCount;
+		auto timestampValidBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndicies.graphicsFamily].timestampValidBits;
+		capabilities.timestampPeriod = timestampValidBits > 0 ? limits.timestampPeriod : 0.0f;
+
+		result.emplace_back(physicalDevice, logicalDevice, surface, preferSplitQueue, capabilities);
 	}
 	
 	return result;
@@ -77,6 +120,7 @@ Device::QueueFamilyIndices Device::findQueueFamilies(const vk::PhysicalDevice &
 {
 	int graphicsQueueFamily = QueueFamilyIndices::NOT_FOUND();
 	int presentQueueFamily = QueueFamilyIndices::NOT_FOUND();
+	int transferQueueFamily = QueueFamilyIndices::NOT_FOUND();
 
 	auto queueFamilies = device.getQueueFamilyProperties();
 
@@ -91,34 +135,64 @@ Device::QueueFamilyIndices Device::findQueueFamilies(const vk::PhysicalDevice &
 				graphicsQueueFamily = i;
 			}
 
-			if ((presentQueueFamily == QueueFamilyIndices::NOT_FOUND() ||
+			if (!surface.isHeadless() &&
+				(presentQueueFamily == QueueFamilyIndices::NOT_FOUND() ||
 				((presentQueueFamily == graphicsQueueFamily) && preferSplitQueue)) &&
 				device.getSurfaceSupportKHR(i, static_cast<vk::SurfaceKHR>(surface))) {
 				presentQueueFamily = i;
 			}
+
+			// A family that can only transfer is usually backed by the DMA engines, which copy alongside rendering.
+			if (transferQueueFamily == QueueFamilyIndices::NOT_FOUND() &&
+				queueFamily.queueFlags & vk::QueueFlagBits::eTransfer &&
+				!(queueFamily.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+			{
+				transferQueueFamily = i;
+			}
 		}
 	}
 
-	return { graphicsQueueFamily, presentQueueFamily };
+	// Offscreen swapchains are "presented" on the graphics queue.
+	if (surface.isHeadless()) {
+		presentQueueFamily = graphicsQueueFamily;
+	}
+
+	QueueFamilyIndices indices;
+	indices.graphicsFamily = graphicsQueueFamily;
+	indices.presentFamily = presentQueueFamily;
+	indices.transferFamily = transferQueueFamily;
+
+	// Otherwise streaming falls back to a second graphics queue, or shares the only one.
+	if (transferQueueFamily == QueueFamilyIndices::NOT_FOUND() && graphicsQueueFamily != QueueFamilyIndices::NOT_FOUND()) {
+		indices.transferFamily = graphicsQueueFamily;
+		indices.transferQueueIndex = queueFamilies[graphicsQueueFamily].queueCount > 1 ? 1 : 0;
+	}
+
+	return indices;
 }
   
-std::vector<vk::DeviceQueueCreateInfo> Device::createQueueCreateInfos(QueueFamilyIndices queueFamilyIndices, const float& queuePriority)
+std::vector<vk::DeviceQueueCreateInfo> Device::createQueueCreateInfos(QueueFamilyIndices queueFamilyIndices, const float* queuePriorities)
 {
-	std::set<int> uniqueQueueFamilyIndicies;
+	std::map<int, uint32_t> queueCounts;	//<-- family -> number of queues
 	if (queueFamilyIndices.hasGraphicsFamily()) {
-		uniqueQueueFamilyIndicies.emplace(queueFamilyIndices.graphicsFamily);
+		queueCounts[queueFamilyIndices.graphicsFamily] = 1;
 	}
 
 	if (queueFamilyIndices.hasPresentFamily()) {
-		uniqueQueueFamilyIndicies.emplace(queueFamilyIndices.presentFamily);
+		queueCounts[queueFamilyIndices.presentFamily] = 1;
+	}
+
+	if (queueFamilyIndices.transferFamily != QueueFamilyIndices::NOT_FOUND()) {
+		auto& count = queueCounts[queueFamilyIndices.transferFamily];
+		count = std::max(count, queueFamilyIndices.transferQueueIndex + 1);
 	}
 
 	auto queueCreateInfos = std::vector<vk::DeviceQueueCreateInfo>();
-	for (auto queueFamilyIndex : uniqueQueueFamilyIndicies) {
+	for (auto& queueCount : queueCounts) {
 		queueCreateInfos.push_back(vk::DeviceQueueCreateInfo()
-			.setQueueCount(1)					//<-- TODO: setable?
-			.setPQueuePriorities(&queuePriority)
-			.setQueueFamilyIndex(queueFamilyIndex));
+			.setQueueCount(queueCount.second)
+			.setPQueuePriorities(queuePriorities)
+			.setQueueFamilyIndex(queueCount.first));
 	}
 
 	return queueCreateInfos;
@@ -173,8 +247,8 @@ bool Device::isPhysicalDeviceSuitable(const vk::PhysicalDevice & physicalDevice,
 
 	bool extensionsSupported = areExtensionsSupported(physicalDevice, extensions);
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	bool swapChainAdequate = surface.isHeadless();
+	if (extensionsSupported && !surface.isHeadless()) {
 		auto swapChainSupport = querySwapChainSupport(physicalDevice, surface);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentmodes.empty();
 	}
@@ -182,6 +256,29 @@ bool Device::isPhysicalDeviceSuitable(const vk::PhysicalDevice & physicalDevice,
 	return queueFamilyIndicies.isComplete() && extensionsSupported && swapChainAdequate;
 }
 
+bool Device::isTimelineSemaphoreSupported(const vk::PhysicalDevice & physicalDevice, Surface& surface)
+{
+	if (!surface.m_hasPhysicalDeviceProperties2 || !areExtensionsSupported(physicalDevice, { VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME })) {
+		return false;
+	}
+
+	auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+		surface.m_vkInstance->getProcAddr("vkGetPhysicalDeviceFeatures2KHR"));
+	if (getFeatures2 == nullptr) {
+		return false;
+	}
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+	timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+	VkPhysicalDeviceFeatures2KHR features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &timelineSemaphoreFeatures;
+
+	getFeatures2(static_cast<VkPhysicalDevice>(physicalDevice), &features);
+	return timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+}
+
 bool Device::areExtensionsSupported(const vk::PhysicalDevice & physicalDevice, const std::vector<const char*>& extensions)
 {
 	std::set<std::string> requiredExtensions(ITERATE(extensions));
@@ -200,7 +297,7 @@ std::unique_ptr<IParameterBlock> Device::createParameterBlock(IRenderPass & rend
 }
 
 
-vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat, vk::Format depthStencilFormat) const
+vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat, vk::Format depthStencilFormat, bool attachmentOptimal) const
 {
 	if (GetDepthStencilFlags(colorFormat) != DepthStencilFlags::eNone) {
 		PAPAGO_ERROR("Supplied color format is a depth/stencil buffer format!");
@@ -224,8 +321,8 @@ vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat, vk::Form
 		.setStoreOp(vk::AttachmentStoreOp::eStore)
 		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-		.setInitialLayout(vk::ImageLayout::eGeneral)
-		.setFinalLayout(vk::ImageLayout::eGeneral);
+		.setInitialLayout(attachmentOptimal ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::eGeneral)
+		.setFinalLayout(attachmentOptimal ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::eGeneral);
 
 	vk::AttachmentReference colorAttachmentRef(0, vk::ImageLayout::eColorAttachmentOptimal);
 	
@@ -248,8 +345,8 @@ vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat, vk::Form
 			
 	vk::AttachmentDescription depthAttachment;
 	depthAttachment.setFormat(format)
-		.setInitialLayout(vk::ImageLayout::eGeneral)
-		.setFinalLayout(vk::ImageLayout::eGeneral);
+		.setInitialLayout(attachmentOptimal ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eGeneral)
+		.setFinalLayout(attachmentOptimal ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eGeneral);
 
 	if (depthStencilFormat == vk::Format::eS8Uint)
 	{
@@ -297,7 +394,7 @@ vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat, vk::Form
 	return m_vkDevice->createRenderPassUnique(renderPassInfo);
 }
 
-vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat) const
+vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat, bool attachmentOptimal) const
 {
 	if (GetDepthStencilFlags(colorFormat) != DepthStencilFlags::eNone) {
 		PAPAGO_ERROR("Supplied color format is a depth/stencil buffer format!");
@@ -310,8 +407,8 @@ vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat) const
 		.setStoreOp(vk::AttachmentStoreOp::eStore)
 		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-		.setInitialLayout(vk::ImageLayout::eGeneral)
-		.setFinalLayout(vk::ImageLayout::eGeneral);
+		.setInitialLayout(attachmentOptimal ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::eGeneral)
+		.setFinalLayout(attachmentOptimal ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::eGeneral);
 
 	vk::AttachmentReference colorAttachmentRef(0, vk::ImageLayout::eColorAttachmentOptimal);
 
@@ -343,6 +440,10 @@ vk::UniqueRenderPass Device::createVkRenderpass(vk::Format colorFormat) const
 // framebufferCount is a prefered minimum of buffers in the swapchain
 std::unique_ptr<SwapChain> Device::createSwapChain(const vk::Format& format, size_t framebufferCount, vk::PresentModeKHR preferredPresentMode)
 {
+	if (m_surface.isHeadless()) {
+		return createOffscreenSwapChain(format, vk::Format::eUndefined, framebufferCount);
+	}
+
 	auto details = querySwapChainSupport(m_vkPhysicalDevice, m_surface);
 
 	auto swapFormat = chooseSwapSurfaceFormat(format, details.formats);
@@ -384,6 +485,10 @@ std::unique_ptr<SwapChain> Device::createSwapChain(const vk::Format& format, siz
 
 std::unique_ptr<SwapChain> Device::createSwapChain(const vk::Format & colorFormat, vk::Format depthStencilFormat, size_t framebufferCount, vk::PresentModeKHR preferredPresentMode)
 {
+	if (m_surface.isHeadless()) {
+		return createOffscreenSwapChain(colorFormat, depthStencilFormat, framebufferCount);
+	}
+
 	auto details = querySwapChainSupport(m_vkPhysicalDevice, m_surface);
 
 	auto swapFormat = chooseSwapSurfaceFormat(colorFormat, details.formats);
@@ -431,6 +536,43 @@ std::unique_ptr<SwapChain> Device::createSwapChain(const vk::Format & colorForma
 	return std::make_unique<SwapChain>(*this, swapChain, colorResources, depthResources, extent);
 }
 
+// The images of a headless swapchain are ordinary render targets of the surface's size. They stay in the general
+// layout, so they can be downloaded after the frame rendering to them is complete.
+std::unique_ptr<SwapChain> Device::createOffscreenSwapChain(vk::Format colorFormat, vk::Format depthStencilFormat, size_t framebufferCount)
+{
+	if (framebufferCount == 0) {
+		PAPAGO_ERROR("A swapchain needs at least one image!");
+	}
+
+	auto format = ImageResource::findSupportedFormat(m_vkPhysicalDevice, { colorFormat }, vk::ImageTiling::eOptimal, vk::FormatFeatureFlagBits::eColorAttachment);
+	vk::Extent2D extent = { uint32_t(m_surface.getWidth()), uint32_t(m_surface.getHeight()) };
+	auto resourceExtent = vk::Extent3D(extent.width, extent.height, 1);
+
+	std::vector<ImageResource> colorResources, depthResources;
+	for (size_t i = 0; i < framebufferCount; ++i) {
+		auto image = m_vkDevice->createImage(vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setExtent(resourceExtent)
+			.setFormat(format)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setMipLevels(1)
+			.setArrayLayers(1)
+			.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst));
+		auto memoryRequirements = m_vkDevice->getImageMemoryRequirements(image);
+		colorResources.emplace_back(image, *this, vk::ImageAspectFlagBits::eColor, format, resourceExtent, memoryRequirements);
+
+		if (depthStencilFormat != vk::Format::eUndefined) {
+			depthResources.emplace_back(ImageResource::createDepthResource(*this, resourceExtent, { depthStencilFormat }));
+		}
+	}
+
+	vk::UniqueSwapchainKHR noSwapChain;
+	if (depthResources.empty()) {
+		return std::make_unique<SwapChain>(*this, noSwapChain, colorResources, extent);
+	}
+	return std::make_unique<SwapChain>(*this, noSwapChain, colorResources, depthResources, extent);
+}
+
 std::unique_ptr<ISwapchain> Device::createSwapChain(Format format, size_t framebufferCount, PresentMode preferredPesentMode)
 {
 	vk::PresentModeKHR vkPreferredPresentMode;
@@ -461,13 +603,18 @@ std::unique_ptr<ISwapchain> Device::createSwapChain(Format colorFormat, Format d
 	return createSwapChain(to_vulkan_format(colorFormat), to_vulkan_format(depthStencilFormat), framebufferCount, vkPreferredPresentMode);
 }
 
-std::unique_ptr<IGraphicsQueue> Device::createGraphicsQueue()
+std::unique_ptr<IGraphicsQueue> Device::createGraphicsQueue(size_t framesInFlight)
 {
+	if (framesInFlight == 0) {
+		PAPAGO_ERROR("A graphics queue needs at least one frame in flight!");
+	}
+
 	auto queueFamilyIndices = findQueueFamilies(m_vkPhysicalDevice, m_surface, m_preferSplitQueue);
 	return std::make_unique<GraphicsQueue>(
 		*this, 
 		queueFamilyIndices.graphicsFamily, 
-		queueFamilyIndices.presentFamily 
+		queueFamilyIndices.presentFamily,
+		framesInFlight
 	);
 }
 
@@ -476,13 +623,20 @@ std::unique_ptr<ICommandBuffer> Device::createCommandBuffer()
 	auto queueFamilyIndices = findQueueFamilies(m_vkPhysicalDevice, m_surface, m_preferSplitQueue);
 	return std::make_unique<CommandBuffer>(
 		m_vkDevice, 
-		queueFamilyIndices.graphicsFamily);
+		queueFamilyIndices.graphicsFamily,
+		m_capabilities);
+}
+
+std::unique_ptr<IFrameGraph> Device::createFrameGraph()
+{
+	auto queueFamilyIndices = findQueueFamilies(m_vkPhysicalDevice, m_surface, m_preferSplitQueue);
+	return std::make_unique<FrameGraph>(*this, queueFamilyIndices.graphicsFamily);
 }
 
 std::unique_ptr<ISubCommandBuffer> Device::createSubCommandBuffer()
 {
 	auto queueFamilyIndex = findQueueFamilies(m_vkPhysicalDevice, m_surface, m_preferSplitQueue).graphicsFamily;
-	return std::make_unique<SubCommandBuffer>(m_vkDevice, queueFamilyIndex);
+	return std::make_unique<SubCommandBuffer>(m_vkDevice, queueFamilyIndex, m_capabilities);
 }
 
 std::unique_ptr<IDynamicBufferResource> Device::createDynamicUniformBuffer(size_t objectSize, int objectCount)
@@ -498,7 +652,7 @@ std::unique_ptr<IDynamicBufferResource> Device::createDynamicUniformBuffer(size_
 
 	const auto buffer_size = dynamic_alligment * objectCount;
 	auto buffer = BufferResource::createBufferResource(
-		m_vkPhysicalDevice, 
+		*m_allocator, 
 		m_vkDevice, 
 		buffer_size, 
 		vk::BufferUsageFlagBits::eUniformBuffer, 
@@ -531,52 +685,179 @@ ImageResource Device::createTexture2D(uint32_t width, uint32_t height, vk::Forma
 
 std::unique_ptr<IShaderProgram> Device::createShaderProgram(IVertexShader &vertexShader, IFragmentShader &fragmentShader)
 {
+	// The parser doesn't know the device, so the bindings and locations named by the shader are checked here.
+	auto limits = m_vkPhysicalDevice.getProperties().limits;
+	auto& internalVertexShader = static_cast<VertexShader&>(vertexShader);
+	if (internalVertexShader.m_inputBindings.size() > limits.maxVertexInputBindings) {
+		PAPAGO_ERROR("The vertex shader reads from binding " + std::to_string(internalVertexShader.m_inputBindings.size() - 1)
+			+ ", but the device supports " + std::to_string(limits.maxVertexInputBindings) + " vertex input bindings");
+	}
+	if (internalVertexShader.m_input.size() > limits.maxVertexInputAttributes) {
+		PAPAGO_ERROR("The vertex shader uses location " + std::to_string(internalVertexShader.m_input.size() - 1)
+			+ ", but the device supports " + std::to_string(limits.maxVertexInputAttributes) + " vertex input attributes");
+	}
+
 	return std::make_unique<ShaderProgram>(m_vkDevice, (VertexShader&)vertexShader, (FragmentShader&)fragmentShader);
 }
 
 std::unique_ptr<IBufferResource> Device::createUniformBuffer(size_t size)
 {
 	return BufferResource::createBufferResource(
-		m_vkPhysicalDevice,
+		*m_allocator,
 		m_vkDevice,
 		size,
 		vk::BufferUsageFlagBits::eUniformBuffer,
 		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
 }
 
-std::unique_ptr<IBufferResource> Device::createVertexBufferInternal(std::vector<char>& data)
+std::unique_ptr<IBufferResource> Device::createVertexBufferInternal(const void* data, size_t bufferSize, BufferMemoryPlacement placement)
 {
-	size_t bufferSize = data.size();
 	auto buffer = BufferResource::createBufferResource(
-		m_vkPhysicalDevice,
+		*m_allocator,
 		m_vkDevice,
 		bufferSize,
 		vk::BufferUsageFlagBits::eVertexBuffer,
-		// TODO: Convert to device local memory when command pool and buffers are ready
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+		getMemoryFlags(placement),
+		BufferResourceElementType::eChar,
+		m_stagingRing.get());
 
-	buffer->upload(data);
+	buffer->upload(data, bufferSize);
 	return buffer;
 }
 
-std::unique_ptr<IBufferResource> Device::createIndexBufferInternal(std::vector<char>& data, BufferResourceElementType type)
+std::unique_ptr<IBufferResource> Device::createIndexBufferInternal(const void* data, size_t bufferSize, BufferResourceElementType type, BufferMemoryPlacement placement)
 {
-	size_t bufferSize = data.size();
 	auto buffer = BufferResource::createBufferResource(
-		m_vkPhysicalDevice,
+		*m_allocator,
 		m_vkDevice,
 		bufferSize,
 		vk::BufferUsageFlagBits::eIndexBuffer,
-		// TODO: Convert to device local memory when command pool and buffers are ready
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		type);
+		getMemoryFlags(placement),
+		type,
+		m_stagingRing.get());
 
-	buffer->upload(data);
+	buffer->upload(data, bufferSize);
 	return buffer;
 }
 
+std::unique_ptr<IBufferResource> Device::createIndirectBufferInternal(const void* data, size_t bufferSize, BufferMemoryPlacement placement)
+{
+	auto buffer = BufferResource::createBufferResource(
+		*m_allocator,
+		m_vkDevice,
+		bufferSize,
+		vk::BufferUsageFlagBits::eIndirectBuffer,
+		getMemoryFlags(placement),
+		BufferResourceElementType::eChar,
+		m_stagingRing.get());
+
+	buffer->upload(data, bufferSize);
+	return buffer;
+}
+
+vk::MemoryPropertyFlags Device::getMemoryFlags(BufferMemoryPlacement placement)
+{
+	switch (placement)
+	{
+	case BufferMemoryPlacement::eDeviceLocal:
+		return vk::MemoryPropertyFlagBits::eDeviceLocal;
+	case BufferMemoryPlacement::eHostVisible:
+		return vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	default:
+		PAPAGO_ERROR("Unknown buffer memory placement");
+	}
+}
+
+UploadToken Device::uploadAsyncInternal(IBufferResource& resource, const void* data, size_t size, const SubmissionHandle& after)
+{
+	auto& buffer = dynamic_cast<BufferResource&>(resource);
+	if (size > buffer.m_vkInfo.range) {
+		PAPAGO_ERROR("Upload is larger than the buffer!");
+	}
+
+	// Host visible buffers are written right away.
+	if (!buffer.m_stagingRing) {
+		after.wait();
+		buffer.upload(data, size);
+		return makeUploadToken(0);
+	}
+
+	waitOnTransferQueue(after);
+
+	auto vkBuffer = *buffer.m_vkBuffer;
+	auto release = vk::BufferMemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead)
+		.setBuffer(vkBuffer)
+		.setOffset(0)
+		.setSize(VK_WHOLE_SIZE);
+
+	auto id = m_transferRing->upload(data, size, [&](vk::CommandBuffer commandBuffer, vk::Buffer stagingBuffer, vk::DeviceSize offset) {
+		commandBuffer.copyBuffer(stagingBuffer, vkBuffer, { vk::BufferCopy(offset, 0, size) });
+	}, { release }, {});
+
+	return makeUploadToken(id);
+}
+
+UploadToken Device::uploadAsync(IImageResource& resource, const std::vector<char>& data, const SubmissionHandle& after)
+{
+	auto& image = dynamic_cast<ImageResource&>(resource);
+
+	// A new image is transitioned and cleared through the graphics ring, which has to happen before the copy, and the
+	// copy is acquired in a later graphics batch. A transfer ring sharing the graphics queue is ordered after the
+	// submitted batch, a separate transfer queue waits for it.
+	auto initialized = m_stagingRing->flush();
+	if (m_vkTransferQueue != m_vkInternalQueue) {
+		m_stagingRing->wait(initialized);
+	}
+
+	waitOnTransferQueue(after);
+	return makeUploadToken(image.uploadAsync(*m_transferRing, data));
+}
+
+// A transfer ring sharing the graphics queue starts every batch with a barrier against the earlier submissions, and
+// its batches are submitted after the submission that handed out the handle. A separate transfer queue waits on the
+// submission's timeline semaphore, or the host waits when timeline semaphores aren't supported.
+void Device::waitOnTransferQueue(const SubmissionHandle& after)
+{
+	if (after.isComplete() || m_vkTransferQueue == m_vkInternalQueue) {
+		return;
+	}
+
+	auto semaphore = static_cast<GraphicsQueue&>(*after.m_queue).m_submissions.getTimelineSemaphore();
+	if (semaphore) {
+		m_transferRing->waitFor(semaphore, after.m_id);
+	}
+	else {
+		after.wait();
+	}
+}
+
+// The transfer ring only submits when flushed, so polling a token gets its upload going.
+bool Device::isUploadComplete(uint64_t id)
+{
+	m_transferRing->flush();
+	return m_transferRing->isComplete(id);
+}
+
+void Device::waitUpload(uint64_t id)
+{
+	m_transferRing->wait(id);
+}
+
+void Device::flushStagingRings() const
+{
+	m_transferRing->flush();
+	for (auto& handoff : m_transferRing->takeHandoffs()) {
+		m_stagingRing->acquire(std::move(handoff));
+	}
+	m_stagingRing->flush();
+}
+
 void Device::waitIdle()
 {
+	flushStagingRings();
+	auto queueLocks = lockQueues();
 	m_vkDevice->waitIdle();
 }
 
@@ -590,15 +871,33 @@ const vk::PhysicalDevice& Device::getVkPhysicalDevice() const
 	return m_vkPhysicalDevice;
 }
 
+std::mutex& Device::getQueueMutex(vk::Queue queue) const
+{
+	std::lock_guard<std::mutex> lock(m_queueMutexes->mutex);
+	return m_queueMutexes->queues[static_cast<VkQueue>(queue)];
+}
+
+std::vector<std::unique_lock<std::mutex>> Device::lockQueues() const
+{
+	std::lock_guard<std::mutex> lock(m_queueMutexes->mutex);
+	std::vector<std::unique_lock<std::mutex>> result;
+	for (auto& queue : m_queueMutexes->queues) {
+		result.emplace_back(queue.second);
+	}
+	return result;
+}
+
 std::unique_ptr<IRenderPass> Device::createRenderPass(IShaderProgram & program, uint32_t width, uint32_t height, Format colorFormat)
 {
 	auto vkPass = createVkRenderpass(to_vulkan_format(colorFormat));
-	return std::make_unique<RenderPass>(
+	auto renderPass = std::make_unique<RenderPass>(
 		m_vkDevice,
 		vkPass,
 		static_cast<ShaderProgram&>(program),
 		vk::Extent2D{ width, height },
 		DepthStencilFlags::eNone);
+	renderPass->m_vkAttachmentOptimalRenderPass = createVkRenderpass(to_vulkan_format(colorFormat), true);
+	return renderPass;
 }
 
 std::unique_ptr<IRenderPass> Device::createRenderPass(IShaderProgram & program, uint32_t width, uint32_t height, Format colorFormat, Format depthStencilFormat)
@@ -606,12 +905,14 @@ std::unique_ptr<IRenderPass> Device::createRenderPass(IShaderProgram & program,
 	auto& innerProgram = dynamic_cast<ShaderProgram&>(program);
 	auto renderPasses = std::vector<vk::UniqueRenderPass>();
 	auto vkPass = createVkRenderpass(to_vulkan_format(colorFormat), to_vulkan_format(depthStencilFormat));
-	return std::make_unique<RenderPass>(
+	auto renderPass = std::make_unique<RenderPass>(
 		m_vkDevice,
 		vkPass,
 		static_cast<ShaderProgram&>(program),
 		vk::Extent2D{ width, height },
 		GetDepthStencilFlags(to_vulkan_format(depthStencilFormat)));
+	renderPass->m_vkAttachmentOptimalRenderPass = createVkRenderpass(to_vulkan_format(colorFormat), to_vulkan_format(depthStencilFormat), true);
+	return renderPass;
 }
 
 std::unique_ptr<ISampler> Device::createTextureSampler1D(Filter magFilter, Filter minFilter, TextureWrapMode modeU)
@@ -653,21 +954,89 @@ std::unique_ptr<ISampler> Device::createTextureSampler3D(Filter magFilter, Filte
 	return sampler;
 }
 
-std::unique_ptr<IImageResource> Device::createTexture2D(size_t width, size_t height, Format format)
+std::unique_ptr<IImageResource> Device::createTexture2D(size_t width, size_t height, Format format, uint32_t mipLevels)
 {
 	vk::Extent3D extent = { uint32_t(width), uint32_t(height), 1 };
+	if (mipLevels == 0) {
+		mipLevels = ImageResource::getFullMipLevelCount(extent);
+	}
+
+	auto vkFormat = to_vulkan_format(format);
+	// transfer source for downloads and for blitting the mip chain
+	auto usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled;
+
+	// Block compressed formats can only be sampled, and fail here if the device doesn't support them.
+	if (isBlockCompressed(vkFormat)) {
+		if (!m_capabilities.textureCompressionBC) {
+			PAPAGO_ERROR("Block compressed textures require the textureCompressionBC feature!");
+		}
+		vkFormat = ImageResource::findSupportedFormat(m_vkPhysicalDevice, { vkFormat }, vk::ImageTiling::eOptimal, vk::FormatFeatureFlagBits::eSampledImage);
+	}
+	else {
+		usage |= vk::ImageUsageFlagBits::eColorAttachment;
+	}
+
 	vk::ImageCreateInfo info;
 	info.setImageType(vk::ImageType::e2D)
 		.setExtent(extent)
-		.setFormat(to_vulkan_format(format))
+		.setFormat(vkFormat)
 		.setInitialLayout(vk::ImageLayout::eUndefined)
-		.setMipLevels(1)
+		.setMipLevels(mipLevels)
 		.setArrayLayers(1)
-		.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eColorAttachment);
+		.setUsage(usage);
 
 	auto image = m_vkDevice->createImage(info);
 	auto memoryRequirements = m_vkDevice->getImageMemoryRequirements(image);
-	return std::make_unique<ImageResource>(image, *this, vk::ImageAspectFlagBits::eColor, to_vulkan_format(format), extent, memoryRequirements);
+	return std::make_unique<ImageResource>(image, *this, vk::ImageAspectFlagBits::eColor, vkFormat, extent, memoryRequirements, mipLevels);
+}
+
+std::unique_ptr<IImageResource> Device::createTexture2D(const TextureFile& file)
+{
+	auto texture = createTexture2D(file.getWidth(), file.getHeight(), file.getFormat(), file.getMipLevels());
+	auto& image = static_cast<ImageResource&>(*texture);
+
+	// Every level goes straight from the file data into the staging ring.
+	for (uint32_t level = 0; level < file.getMipLevels(); ++level) {
+		image.upload(file.getLevelData(level), file.getLevelSize(level), level);
+	}
+
+	return texture;
+}
+
+MemoryStatistics Device::getMemoryStatistics() const
+{
+	MemoryStatistics statistics;
+	statistics.heaps = m_allocator->getStatistics();
+
+	if (m_capabilities.memoryBudget) {
+		auto getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+			m_surface.m_vkInstance->getProcAddr("vkGetPhysicalDeviceMemoryProperties2KHR"));
+
+		if (getMemoryProperties2 != nullptr) {
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+			VkPhysicalDeviceMemoryProperties2KHR memoryProperties = {};
+			memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+			memoryProperties.pNext = &budgetProperties;
+
+			getMemoryProperties2(static_cast<VkPhysicalDevice>(m_vkPhysicalDevice), &memoryProperties);
+
+			for (size_t i = 0; i < statistics.heaps.size(); ++i) {
+				statistics.heaps[i].budget = budgetProperties.heapBudget[i];
+				statistics.heaps[i].usage = budgetProperties.heapUsage[i];
+			}
+			statistics.budgetFromDriver = true;
+			return statistics;
+		}
+	}
+
+	// Without the extension only Papago's own blocks are known. Leaves room for other processes and the driver.
+	for (auto& heap : statistics.heaps) {
+		heap.budget = heap.size / 10 * 8;
+		heap.usage = heap.blockBytes;
+	}
+	return statistics;
 }
 
 std::unique_ptr<IImageResource> Device::createDepthTexture2D(uint32_t width, uint32_t height, Format format)
@@ -675,14 +1044,31 @@ std::unique_ptr<IImageResource> Device::createDepthTexture2D(uint32_t width, uin
 	return std::make_unique<ImageResource>(ImageResource::createDepthResource(*this, { width, height, 1 }, { to_vulkan_format(format) }));
 }
 
-Device::Device(vk::PhysicalDevice physicalDevice, vk::UniqueDevice &device, Surface &surface, bool preferSplitQueue)
+Device::Device(vk::PhysicalDevice physicalDevice, vk::UniqueDevice &device, Surface &surface, bool preferSplitQueue, const DeviceCapabilities& capabilities)
 	: m_vkPhysicalDevice(physicalDevice)
 	, m_vkDevice(std::move(device))
+	, m_allocator(std::make_unique<MemoryAllocator>(physicalDevice, *m_vkDevice))
+	, m_queueMutexes(std::make_unique<QueueMutexes>())
 	, m_surface(surface)
 	, m_preferSplitQueue(preferSplitQueue)
-	, m_internalCommandBuffer(CommandBuffer{ m_vkDevice, findQueueFamilies(physicalDevice, surface,  m_preferSplitQueue).graphicsFamily})
+	, m_capabilities(capabilities)
 {
-	m_vkInternalQueue = m_vkDevice->getQueue(findQueueFamilies(physicalDevice, surface, m_preferSplitQueue).graphicsFamily, 0);
+	auto queueFamilyIndices = findQueueFamilies(physicalDevice, surface, m_preferSplitQueue);
+	auto graphicsFamily = queueFamilyIndices.graphicsFamily;
+	m_vkInternalQueue = m_vkDevice->getQueue(graphicsFamily, 0);
+
+	m_stagingRing = std::make_unique<StagingRing>(*m_vkDevice, *m_allocator, graphicsFamily, m_vkInternalQueue, getQueueMutex(m_vkInternalQueue));
+
+	// Uploads made on a queue of their own are handed over to the graphics queue, see flushStagingRings.
+	m_vkTransferQueue = m_vkDevice->getQueue(queueFamilyIndices.transferFamily, queueFamilyIndices.transferQueueIndex);
+	m_transferRing = std::make_unique<StagingRing>(
+		*m_vkDevice,
+		*m_allocator,
+		queueFamilyIndices.transferFamily,
+		m_vkTransferQueue,
+		getQueueMutex(m_vkTransferQueue),
+		StagingRing::DEFAULT_SIZE(),
+		m_vkTransferQueue != m_vkInternalQueue ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED);
 }
 
 Device::SwapChainSupportDetails Device::querySwapChainSupport(const vk::PhysicalDevice& physicalDevice, Surface& surface) 
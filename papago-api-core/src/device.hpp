@@ -1,8 +1,13 @@
 #pragma once
 #include <vector>
-#include "IDevice.hpp"
+#include <map>
+#include <mutex>
+#include "idevice.hpp"
 #include "api_enums.hpp"
 #include "command_buffer.hpp"
+#include "memory_allocator.hpp"
+#include "staging_ring.hpp"
+#include "device_capabilities.hpp"
 
 class IVertexShader;
 class IFragmentShader;
@@ -24,7 +29,7 @@ struct ParameterBinding;
 class Device : public IDevice {
 public:
 	static std::vector<Device> enumerateDevices(Surface& surface, const vk::PhysicalDeviceFeatures &features, const std::vector<const char*> &extensions, bool = false);
-	Device(vk::PhysicalDevice, vk::UniqueDevice&, Surface&, bool preferSplitQueue);
+	Device(vk::PhysicalDevice, vk::UniqueDevice&, Surface&, bool preferSplitQueue, const DeviceCapabilities&);
 
 	std::unique_ptr<ISwapchain> createSwapChain(Format, size_t framebufferCount, PresentMode preferredPresentMode) override;
 	std::unique_ptr<ISwapchain> createSwapChain(Format colorFormat, Format depthStencilFormat, size_t framebufferCount, PresentMode preferredPresentMode) override;
@@ -33,39 +38,70 @@ public:
 	std::unique_ptr<ISampler> createTextureSampler1D(Filter magFil, Filter minFil, TextureWrapMode modeU) override;
 	std::unique_ptr<ISampler> createTextureSampler2D(Filter magFil, Filter minFil, TextureWrapMode modeU, TextureWrapMode modeV) override;
 	std::unique_ptr<ISampler> createTextureSampler3D(Filter magFil, Filter minFil, TextureWrapMode modeU, TextureWrapMode modeV, TextureWrapMode modeW) override;
-	std::unique_ptr<IImageResource> createTexture2D(size_t width, size_t height, Format) override;
+	std::unique_ptr<IImageResource> createTexture2D(size_t width, size_t height, Format, uint32_t mipLevels = 1) override;
+	std::unique_ptr<IImageResource> createTexture2D(const TextureFile&) override;
 	std::unique_ptr<IImageResource> createDepthTexture2D(uint32_t width, uint32_t height, Format) override;
 	std::unique_ptr<ICommandBuffer> createCommandBuffer() override;
 	std::unique_ptr<ISubCommandBuffer> createSubCommandBuffer() override;
+	std::unique_ptr<IFrameGraph> createFrameGraph() override;
 	std::unique_ptr<IShaderProgram> createShaderProgram(IVertexShader&, IFragmentShader&) override;
 	std::unique_ptr<IBufferResource> createUniformBuffer(size_t size) override;
-	std::unique_ptr<IGraphicsQueue> createGraphicsQueue() override;
+	std::unique_ptr<IGraphicsQueue> createGraphicsQueue(size_t framesInFlight = 1) override;
+	MemoryStatistics getMemoryStatistics() const override;
 
 	std::unique_ptr<IDynamicBufferResource> createDynamicUniformBuffer(size_t object_size, int object_count) override;
 
-	vk::UniqueRenderPass createVkRenderpass(vk::Format colorFormat) const;
-	vk::UniqueRenderPass createVkRenderpass(vk::Format colorFormat, vk::Format depthStencilFormat) const;
+	// With attachmentOptimal the attachments are expected, and left, in their optimal layouts instead of the general layout.
+	vk::UniqueRenderPass createVkRenderpass(vk::Format colorFormat, bool attachmentOptimal = false) const;
+	vk::UniqueRenderPass createVkRenderpass(vk::Format colorFormat, vk::Format depthStencilFormat, bool attachmentOptimal = false) const;
 
 	std::unique_ptr<SwapChain> createSwapChain(const vk::Format & format, size_t framebufferCount, vk::PresentModeKHR preferredPresentMode) ;
 	std::unique_ptr<SwapChain> createSwapChain(const vk::Format & colorFormat, vk::Format depthStencilFormat, size_t framebufferCount, vk::PresentModeKHR preferredPresentMode) ;
+	// Used instead of a real swapchain when the surface is headless. Without depth if depthStencilFormat is eUndefined.
+	std::unique_ptr<SwapChain> createOffscreenSwapChain(vk::Format colorFormat, vk::Format depthStencilFormat, size_t framebufferCount);
 
 	std::unique_ptr<IParameterBlock> createParameterBlock(IRenderPass & renderPass, std::vector<ParameterBinding>& bindings) override;
 
+	UploadToken uploadAsync(IImageResource&, const std::vector<char>& data, const SubmissionHandle& after = SubmissionHandle()) override;
+
 	void waitIdle() override;
+	// Submits the pending uploads of both staging rings, handing the asynchronous ones over to the graphics queue.
+	void flushStagingRings() const;
 	const vk::UniqueDevice& getVkDevice() const;
 	const vk::PhysicalDevice& getVkPhysicalDevice() const;
+	// Submitting to or presenting on a queue requires it to be externally synchronized. The staging rings and graphics
+	// queues lock the queue's mutex around it, as several of them may share a VkQueue.
+	std::mutex& getQueueMutex(vk::Queue) const;
+	// vkDeviceWaitIdle synchronizes all queues of the device at once.
+	std::vector<std::unique_lock<std::mutex>> lockQueues() const;
 
 	vk::PhysicalDevice m_vkPhysicalDevice;
 	vk::UniqueDevice m_vkDevice;
+	std::unique_ptr<MemoryAllocator> m_allocator;
+
+	struct QueueMutexes
+	{
+		std::mutex mutex;	//<-- guards the map, not the queues
+		std::map<VkQueue, std::mutex> queues;
+	};
+	std::unique_ptr<QueueMutexes> m_queueMutexes;	//<-- on the heap, as the rings and queues keep references
 
 	Surface& m_surface;
 	bool m_preferSplitQueue;
+	DeviceCapabilities m_capabilities;
 
 	vk::Queue m_vkInternalQueue;
-	CommandBuffer m_internalCommandBuffer;
+	std::unique_ptr<StagingRing> m_stagingRing;
+
+	vk::Queue m_vkTransferQueue;	//<-- may be m_vkInternalQueue, if the device has a single graphics queue and no transfer queue
+	std::unique_ptr<StagingRing> m_transferRing;
 protected:
-	std::unique_ptr<IBufferResource> createVertexBufferInternal(std::vector<char>& data) override;
-	std::unique_ptr<IBufferResource> createIndexBufferInternal(std::vector<char>& data, BufferResourceElementType) override;
+	std::unique_ptr<IBufferResource> createVertexBufferInternal(const void* data, size_t size, BufferMemoryPlacement) override;
+	std::unique_ptr<IBufferResource> createIndexBufferInternal(const void* data, size_t size, BufferResourceElementType, BufferMemoryPlacement) override;
+	std::unique_ptr<IBufferResource> createIndirectBufferInternal(const void* data, size_t size, BufferMemoryPlacement) override;
+	UploadToken uploadAsyncInternal(IBufferResource&, const void* data, size_t size, const SubmissionHandle& after) override;
+	bool isUploadComplete(uint64_t id) override;
+	void waitUpload(uint64_t id) override;
 private:
 	struct SwapChainSupportDetails
 	{
@@ -79,6 +115,8 @@ private:
 
 		int graphicsFamily = NOT_FOUND();
 		int presentFamily = NOT_FOUND();
+		int transferFamily = NOT_FOUND();
+		uint32_t transferQueueIndex = 0;	//<-- 1 when the transfer queue is a second queue of the graphics family
 		
 		bool hasGraphicsFamily() const {
 			return graphicsFamily != NOT_FOUND();
@@ -100,11 +138,15 @@ private:
 	static QueueFamilyIndices findQueueFamilies(const vk::PhysicalDevice& device, Surface& surface, bool preferMultiBuffer);
 	static vk::SurfaceFormatKHR chooseSwapSurfaceFormat(vk::Format,  std::vector<vk::SurfaceFormatKHR>& availableFormats);
 	static vk::PresentModeKHR chooseSwapPresentMode(vk::PresentModeKHR, const std::vector<vk::PresentModeKHR>& availablePresentModes);
+	static vk::MemoryPropertyFlags getMemoryFlags(BufferMemoryPlacement);
 	static vk::Extent2D chooseSwapChainExtent(uint32_t width, uint32_t height, const vk::SurfaceCapabilitiesKHR& availableCapabilities);
-	static std::vector<vk::DeviceQueueCreateInfo> createQueueCreateInfos(QueueFamilyIndices, const float&);
+	static std::vector<vk::DeviceQueueCreateInfo> createQueueCreateInfos(QueueFamilyIndices, const float* queuePriorities);
 	vk::SwapchainCreateInfoKHR createSwapChainCreateInfo(Surface&, const size_t& framebufferCount, const vk::SurfaceFormatKHR&, const vk::Extent2D&, const vk::SurfaceCapabilitiesKHR&, const vk::PresentModeKHR&, uint32_t[]) const;
 
+	void waitOnTransferQueue(const SubmissionHandle&);
+
 	static bool isPhysicalDeviceSuitable(const vk::PhysicalDevice& physicalDevice, Surface&, const std::vector<const char*> &, bool);
+	static bool isTimelineSemaphoreSupported(const vk::PhysicalDevice& physicalDevice, Surface&);
 	static bool areExtensionsSupported(const vk::PhysicalDevice& physicalDevice, const std::vector<const char*> &extensions);	
 
 };
\ No newline at end of file
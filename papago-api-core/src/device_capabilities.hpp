@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+// The optional extensions, features and limits of a device, found by Device::enumerateDevices. The optional extensions
+// and features are enabled whenever the device supports them. The defaults assume none of them.
+struct DeviceCapabilities
+{
+	bool memoryBudget = false;	//<-- VK_EXT_memory_budget is enabled
+	bool timelineSemaphore = false;	//<-- VK_KHR_timeline_semaphore is enabled
+	bool pipelineStatistics = false;	//<-- the pipelineStatisticsQuery feature is enabled
+	bool multiDrawIndirect = false;	//<-- the multiDrawIndirect feature is enabled
+	bool drawIndirectCount = false;	//<-- VK_KHR_draw_indirect_count is enabled
+	bool textureCompressionBC = false;	//<-- the textureCompressionBC feature is enabled
+	uint32_t maxDrawIndirectCount = 1;	//<-- the largest draw count of a single indirect draw
+	float timestampPeriod = 0.0f;	//<-- nanoseconds per timestamp tick, 0 if the graphics queue can't write timestamps
+};
@@ -0,0 +1,531 @@
+#include "standard_header.hpp"
+#include "frame_graph.hpp"
+#include "device.hpp"
+#include "command_buffer.hpp"
+#include "image_resource.hpp"
+#include "render_pass.hpp"
+#include "swap_chain.hpp"
+#include <algorithm>
+#include <set>
+
+namespace {
+	const vk::AccessFlags WRITE_ACCESS = vk::AccessFlagBits::eColorAttachmentWrite
+		| vk::AccessFlagBits::eDepthStencilAttachmentWrite
+		| vk::AccessFlagBits::eShaderWrite
+		| vk::AccessFlagBits::eTransferWrite
+		| vk::AccessFlagBits::eHostWrite
+		| vk::AccessFlagBits::eMemoryWrite;
+}
+
+FrameGraph::FrameGraph(const Device& device, int queueFamilyIndex)
+	: m_device(device)
+	, m_queueFamilyIndex(queueFamilyIndex)
+{
+}
+
+// The framebuffers and transient images may still be in use by the last submissions of the graph.
+FrameGraph::~FrameGraph()
+{
+	if (!m_recordings.empty()) {
+		auto queueLocks = m_device.lockQueues();
+		m_device.m_vkDevice->waitIdle();
+	}
+
+	m_passes.clear();
+	for (auto& image : m_images) {
+		image.transient.reset();
+	}
+	for (auto& memory : m_transientMemory) {
+		m_device.m_allocator->free(memory);
+	}
+}
+
+FrameGraphImage FrameGraph::importImage(IImageResource& image)
+{
+	checkNotCompiled();
+
+	auto resource = &static_cast<ImageResource&>(image);
+	for (uint32_t i = 0; i < m_images.size(); ++i) {
+		if (m_images[i].resource == resource) {
+			return { i };
+		}
+	}
+
+	Image imported;
+	imported.resource = resource;
+	return addImage(std::move(imported));
+}
+
+// The depth buffer, if any, is added right after the image itself.
+FrameGraphImage FrameGraph::importSwapchain(ISwapchain& swapchain)
+{
+	checkNotCompiled();
+
+	auto internalSwapChain = &static_cast<SwapChain&>(swapchain);
+	for (uint32_t i = 0; i < m_images.size(); ++i) {
+		if (m_images[i].swapchain == internalSwapChain && !m_images[i].swapchainDepth) {
+			return { i };
+		}
+	}
+
+	Image color;
+	color.swapchain = internalSwapChain;
+	auto image = addImage(std::move(color));
+
+	if (!internalSwapChain->m_depthResources.empty()) {
+		Image depth;
+		depth.swapchain = internalSwapChain;
+		depth.swapchainDepth = true;
+		addImage(std::move(depth));
+	}
+
+	return image;
+}
+
+FrameGraphImage FrameGraph::createTransientImage(uint32_t width, uint32_t height, Format format)
+{
+	checkNotCompiled();
+
+	if (width == 0 || height == 0) {
+		PAPAGO_ERROR("A transient image can't be empty!");
+	}
+
+	auto vkFormat = to_vulkan_format(format);
+	auto features = GetDepthStencilFlags(vkFormat) != DepthStencilFlags::eNone
+		? vk::FormatFeatureFlagBits::eDepthStencilAttachment
+		: vk::FormatFeatureFlagBits::eColorAttachment;
+
+	Image transient;
+	transient.isTransient = true;
+	transient.format = ImageResource::findSupportedFormat(m_device.m_vkPhysicalDevice, { vkFormat }, vk::ImageTiling::eOptimal, features | vk::FormatFeatureFlagBits::eSampledImage);
+	transient.extent = vk::Extent3D(width, height, 1);
+	return addImage(std::move(transient));
+}
+
+void FrameGraph::addPass(IRenderPass& renderPass, FrameGraphImage color, const std::vector<FrameGraphImage>& sampled, std::function<void(IRecordingCommandBuffer&)> record)
+{
+	checkImage(color);
+
+	// Passes rendering to a swapchain use its depth buffer along with the image.
+	FrameGraphImage depth;
+	auto& colorImage = m_images[color.index];
+	if (colorImage.swapchain && !colorImage.swapchainDepth && !colorImage.swapchain->m_depthResources.empty()) {
+		depth.index = color.index + 1;
+	}
+
+	addPass(renderPass, color, depth, sampled, std::move(record));
+}
+
+void FrameGraph::addPass(IRenderPass& renderPass, FrameGraphImage color, FrameGraphImage depth, const std::vector<FrameGraphImage>& sampled, std::function<void(IRecordingCommandBuffer&)> record)
+{
+	checkNotCompiled();
+	checkImage(color);
+
+	auto& internalRenderPass = static_cast<RenderPass&>(renderPass);
+	if (depth.isValid() != (internalRenderPass.m_depthStencilFlags != DepthStencilFlags::eNone)) {
+		PAPAGO_ERROR("The depth image of the pass doesn't match the render pass!");
+	}
+
+	if (depth.isValid()) {
+		checkImage(depth);
+		if (m_images[depth.index].swapchain != m_images[color.index].swapchain) {
+			PAPAGO_ERROR("A pass rendering to a swapchain must use the swapchain's depth buffer!");
+		}
+	}
+
+	for (auto image : sampled) {
+		checkImage(image);
+		if (image.index == color.index || image.index == depth.index) {
+			PAPAGO_ERROR("A pass can't sample its own attachments!");
+		}
+	}
+
+	Pass pass;
+	pass.renderPass = &internalRenderPass;
+	pass.color = color;
+	pass.depth = depth;
+	pass.sampled = sampled;
+	pass.record = std::move(record);
+	m_passes.emplace_back(std::move(pass));
+}
+
+void FrameGraph::compile()
+{
+	checkNotCompiled();
+
+	sortPasses();
+	createTransientImages();
+	createFramebuffers();
+
+	m_compiled = true;
+}
+
+IImageResource& FrameGraph::getImage(FrameGraphImage image)
+{
+	checkImage(image);
+
+	if (m_images[image.index].isTransient && !m_compiled) {
+		PAPAGO_ERROR("Transient images are created when the frame graph is compiled!");
+	}
+
+	return resolve(image);
+}
+
+// Passes are recorded in their sorted order. Before each pass, the barriers of all its images are recorded in a
+// single vkCmdPipelineBarrier.
+SubmissionHandle FrameGraph::execute(IGraphicsQueue& queue, const std::vector<SubmissionHandle>& waitFor)
+{
+	if (!m_compiled) {
+		compile();
+	}
+
+	auto& recording = takeRecording();
+	auto& commandBuffer = *recording.commandBuffer;
+
+	// Imported images may have been written by earlier submissions, and transient images share their memory with the
+	// previous frame. The first transient image in a piece of memory waits for everything submitted earlier, the
+	// others only for the image before them.
+	m_states.resize(m_images.size());
+	for (size_t i = 0; i < m_images.size(); ++i) {
+		auto& image = m_images[i];
+		if (!image.isTransient) {
+			m_states[i] = { vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eAllCommands, vk::AccessFlagBits::eMemoryWrite };
+		}
+		else if (image.aliasOf == UINT32_MAX) {
+			m_states[i] = { vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eAllCommands, vk::AccessFlagBits::eMemoryWrite };
+		}
+		else {
+			m_states[i] = { vk::ImageLayout::eUndefined, vk::PipelineStageFlags(), vk::AccessFlags() };
+		}
+	}
+
+	commandBuffer.beginCommands();
+
+	for (auto passIndex : m_order) {
+		auto& pass = m_passes[passIndex];
+
+		for (auto image : pass.sampled) {
+			use(image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
+			commandBuffer.m_resourcesInUse.push_back(&resolve(image));
+		}
+
+		use(pass.color, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite);
+		commandBuffer.m_resourcesInUse.push_back(&resolve(pass.color));
+
+		if (pass.depth.isValid()) {
+			use(pass.depth,
+				vk::ImageLayout::eDepthStencilAttachmentOptimal,
+				vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+				vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+			commandBuffer.m_resourcesInUse.push_back(&resolve(pass.depth));
+		}
+
+		recordBarriers(commandBuffer);
+
+		auto& color = resolve(pass.color);
+		auto swapchain = m_images[pass.color.index].swapchain;
+		auto framebuffer = swapchain ? *swapchain->m_vkFramebuffers[swapchain->m_currentFramebufferIndex] : *pass.framebuffer;
+
+		commandBuffer.beginPass(*pass.renderPass, *pass.renderPass->m_vkAttachmentOptimalRenderPass, framebuffer, { color.m_vkExtent.width, color.m_vkExtent.height });
+		pass.record(commandBuffer);
+		commandBuffer.endPass();
+	}
+
+	for (uint32_t i = 0; i < m_images.size(); ++i) {
+		if (!m_images[i].isTransient && m_states[i].layout != vk::ImageLayout::eGeneral) {
+			use({ i }, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eAllCommands, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+		}
+	}
+	recordBarriers(commandBuffer);
+
+	commandBuffer.endCommands();
+
+	recording.submission = queue.submitCommands({ commandBuffer }, waitFor);
+	return recording.submission;
+}
+
+FrameGraphImage FrameGraph::addImage(Image&& image)
+{
+	m_images.emplace_back(std::move(image));
+	return { static_cast<uint32_t>(m_images.size() - 1) };
+}
+
+void FrameGraph::checkNotCompiled() const
+{
+	if (m_compiled) {
+		PAPAGO_ERROR("The frame graph can't be changed once it has been compiled!");
+	}
+}
+
+void FrameGraph::checkImage(FrameGraphImage image) const
+{
+	if (!image.isValid() || image.index >= m_images.size()) {
+		PAPAGO_ERROR("The image doesn't belong to the frame graph!");
+	}
+}
+
+// Passes writing the same image keep their declared order. A pass sampling an image runs after the last pass writing
+// it that was declared before the sampling pass, or after the first writer if there is none, and before the next writer.
+// Independent passes also keep their declared order.
+void FrameGraph::sortPasses()
+{
+	std::vector<std::vector<size_t>> writers(m_images.size());
+	for (size_t i = 0; i < m_passes.size(); ++i) {
+		writers[m_passes[i].color.index].push_back(i);
+		if (m_passes[i].depth.isValid()) {
+			writers[m_passes[i].depth.index].push_back(i);
+		}
+	}
+
+	std::vector<std::vector<size_t>> successors(m_passes.size());
+	std::vector<size_t> predecessorCount(m_passes.size(), 0);
+	auto addDependency = [&](size_t before, size_t after) {
+		successors[before].push_back(after);
+		++predecessorCount[after];
+	};
+
+	for (auto& imageWriters : writers) {
+		for (size_t i = 1; i < imageWriters.size(); ++i) {
+			addDependency(imageWriters[i - 1], imageWriters[i]);
+		}
+	}
+
+	for (size_t i = 0; i < m_passes.size(); ++i) {
+		for (auto image : m_passes[i].sampled) {
+			auto& imageWriters = writers[image.index];
+			if (imageWriters.empty()) {
+				continue;
+			}
+
+			auto next = std::upper_bound(ITERATE(imageWriters), i);
+			auto producer = next == imageWriters.begin() ? next++ : next - 1;
+			addDependency(*producer, i);
+			if (next != imageWriters.end()) {
+				addDependency(i, *next);
+			}
+		}
+	}
+
+	std::set<size_t> ready;
+	for (size_t i = 0; i < m_passes.size(); ++i) {
+		if (predecessorCount[i] == 0) {
+			ready.insert(i);
+		}
+	}
+
+	m_order.clear();
+	while (!ready.empty()) {
+		auto pass = *ready.begin();
+		ready.erase(ready.begin());
+		m_order.push_back(pass);
+
+		for (auto successor : successors[pass]) {
+			if (--predecessorCount[successor] == 0) {
+				ready.insert(successor);
+			}
+		}
+	}
+
+	if (m_order.size() != m_passes.size()) {
+		PAPAGO_ERROR("The passes of the frame graph depend on each other in a cycle!");
+	}
+}
+
+// Transient images are placed in the order they are first used. An image shares memory with an earlier image whose
+// last pass runs before its first pass, when their memory types allow it; otherwise it gets memory of its own.
+void FrameGraph::createTransientImages()
+{
+	std::vector<size_t> firstUse(m_images.size(), SIZE_MAX);
+	std::vector<size_t> lastUse(m_images.size(), SIZE_MAX);
+	auto markUse = [&](FrameGraphImage image, size_t position) {
+		if (firstUse[image.index] == SIZE_MAX) {
+			firstUse[image.index] = position;
+		}
+		lastUse[image.index] = position;
+	};
+
+	for (size_t position = 0; position < m_order.size(); ++position) {
+		auto& pass = m_passes[m_order[position]];
+		markUse(pass.color, position);
+		if (pass.depth.isValid()) {
+			markUse(pass.depth, position);
+		}
+		for (auto image : pass.sampled) {
+			markUse(image, position);
+		}
+	}
+
+	std::vector<uint32_t> transients;
+	for (uint32_t i = 0; i < m_images.size(); ++i) {
+		if (m_images[i].isTransient) {
+			transients.push_back(i);
+		}
+	}
+	std::stable_sort(ITERATE(transients), [&](uint32_t a, uint32_t b) { return firstUse[a] < firstUse[b]; });
+
+	struct Slot
+	{
+		vk::MemoryRequirements requirements;
+		size_t lastUse;
+		uint32_t lastImage;
+	};
+	std::vector<Slot> slots;
+	std::vector<size_t> slotOfImage(m_images.size());
+	std::vector<vk::Image> vkImages(m_images.size());
+
+	for (auto i : transients) {
+		auto& image = m_images[i];
+		auto usage = GetDepthStencilFlags(image.format) != DepthStencilFlags::eNone
+			? vk::ImageUsageFlagBits::eDepthStencilAttachment
+			: vk::ImageUsageFlagBits::eColorAttachment;
+
+		vkImages[i] = m_device.m_vkDevice->createImage(vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setExtent(image.extent)
+			.setMipLevels(1)
+			.setArrayLayers(1)
+			.setFormat(image.format)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setUsage(usage | vk::ImageUsageFlagBits::eSampled)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setSamples(vk::SampleCountFlagBits::e1));
+		auto requirements = m_device.m_vkDevice->getImageMemoryRequirements(vkImages[i]);
+
+		// Unused images never share their memory, so they can still be fetched with getImage.
+		auto slot = std::find_if(ITERATE(slots), [&](const Slot& candidate) {
+			return firstUse[i] != SIZE_MAX
+				&& candidate.lastUse < firstUse[i]
+				&& (candidate.requirements.memoryTypeBits & requirements.memoryTypeBits) != 0;
+		});
+
+		if (slot == slots.end()) {
+			slotOfImage[i] = slots.size();
+			slots.push_back({ requirements, lastUse[i], i });
+			continue;
+		}
+
+		image.aliasOf = slot->lastImage;
+		slot->requirements.size = std::max(slot->requirements.size, requirements.size);
+		slot->requirements.alignment = std::max(slot->requirements.alignment, requirements.alignment);
+		slot->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+		slot->lastUse = lastUse[i];
+		slot->lastImage = i;
+		slotOfImage[i] = slot - slots.begin();
+	}
+
+	for (auto& slot : slots) {
+		m_transientMemory.push_back(m_device.m_allocator->allocate(slot.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, AllocationKind::eImage));
+	}
+
+	for (auto i : transients) {
+		auto& image = m_images[i];
+		auto aspectFlags = GetDepthStencilFlags(image.format) != DepthStencilFlags::eNone
+			? ImageResource::getDepthStencilAspectFlags(image.format)
+			: vk::ImageAspectFlags(vk::ImageAspectFlagBits::eColor);
+
+		image.transient = std::make_unique<ImageResource>(vkImages[i], m_device, aspectFlags, image.format, image.extent, m_transientMemory[slotOfImage[i]]);
+		image.resource = image.transient.get();
+	}
+}
+
+// Imported and transient images don't change, so their framebuffers are created once. Passes rendering to a swapchain
+// use the framebuffers of the swapchain, which are compatible with the render pass.
+void FrameGraph::createFramebuffers()
+{
+	for (auto& pass : m_passes) {
+		if (m_images[pass.color.index].swapchain) {
+			continue;
+		}
+
+		auto& color = resolve(pass.color);
+		std::vector<vk::ImageView> attachments = { color.getAttachmentView() };
+		if (pass.depth.isValid()) {
+			attachments.push_back(resolve(pass.depth).getAttachmentView());
+		}
+
+		pass.framebuffer = m_device.m_vkDevice->createFramebufferUnique(vk::FramebufferCreateInfo()
+			.setRenderPass(*pass.renderPass->m_vkAttachmentOptimalRenderPass)
+			.setAttachmentCount(attachments.size())
+			.setPAttachments(attachments.data())
+			.setWidth(color.m_vkExtent.width)
+			.setHeight(color.m_vkExtent.height)
+			.setLayers(1));
+	}
+}
+
+ImageResource& FrameGraph::resolve(FrameGraphImage image) const
+{
+	auto& graphImage = m_images[image.index];
+	if (graphImage.resource) {
+		return *graphImage.resource;
+	}
+
+	auto swapchain = graphImage.swapchain;
+	return graphImage.swapchainDepth
+		? swapchain->m_depthResources[swapchain->m_currentFramebufferIndex]
+		: swapchain->m_colorResources[swapchain->m_currentFramebufferIndex];
+}
+
+FrameGraph::Recording& FrameGraph::takeRecording()
+{
+	for (auto& recording : m_recordings) {
+		if (recording.submission.isComplete()) {
+			return recording;
+		}
+	}
+
+	Recording recording;
+	recording.commandBuffer = std::make_unique<CommandBuffer>(m_device.m_vkDevice, m_queueFamilyIndex, m_device.m_capabilities);
+	m_recordings.emplace_back(std::move(recording));
+	return m_recordings.back();
+}
+
+// Queues the barrier needed before the image is used as described, if any. Reads following reads in the same layout
+// need none, but the next write has to wait for all of them.
+void FrameGraph::use(FrameGraphImage image, vk::ImageLayout layout, vk::PipelineStageFlags stages, vk::AccessFlags access)
+{
+	auto& state = m_states[image.index];
+
+	// The first use of a transient image waits for the image that used its memory before it.
+	auto aliasOf = m_images[image.index].aliasOf;
+	if (!state.stages && aliasOf != UINT32_MAX) {
+		state.stages = m_states[aliasOf].stages;
+		state.access = m_states[aliasOf].access;
+	}
+
+	auto writes = bool(access & WRITE_ACCESS);
+	auto written = bool(state.access & WRITE_ACCESS);
+	if (state.layout == layout && !writes && !written) {
+		state.stages |= stages;
+		state.access |= access;
+		return;
+	}
+
+	auto& resource = resolve(image);
+	m_vkBarriers.push_back(vk::ImageMemoryBarrier(
+		state.access & WRITE_ACCESS,
+		access,
+		state.layout,
+		layout,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		resource.m_vkImage,
+		resource.getSubresourceRange()));
+	m_vkBarrierSrcStages |= state.stages ? state.stages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+	m_vkBarrierDstStages |= stages;
+
+	state = { layout, stages, access };
+}
+
+void FrameGraph::recordBarriers(CommandBuffer& commandBuffer)
+{
+	if (m_vkBarriers.empty()) {
+		return;
+	}
+
+	commandBuffer->pipelineBarrier(m_vkBarrierSrcStages, m_vkBarrierDstStages, vk::DependencyFlags(), {}, {}, m_vkBarriers);
+
+	m_vkBarriers.clear();
+	m_vkBarrierSrcStages = vk::PipelineStageFlags();
+	m_vkBarrierDstStages = vk::PipelineStageFlags();
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <functional>
+#include "iframe_graph.hpp"
+#include "memory_allocator.hpp"
+
+class Device;
+class CommandBuffer;
+class ImageResource;
+class RenderPass;
+class SwapChain;
+
+// Records the passes of a frame in dependency order into one command buffer. Attachments and sampled images are kept
+// in their optimal layouts while the graph executes. Imported images are returned to the general layout at the end,
+// as the rest of Papago expects them to be in it.
+class FrameGraph : public IFrameGraph
+{
+public:
+	FrameGraph(const Device&, int queueFamilyIndex);
+	FrameGraph(const FrameGraph&) = delete;
+	~FrameGraph();
+
+	FrameGraphImage importImage(IImageResource&) override;
+	FrameGraphImage importSwapchain(ISwapchain&) override;
+	FrameGraphImage createTransientImage(uint32_t width, uint32_t height, Format) override;
+
+	void addPass(IRenderPass&, FrameGraphImage color, const std::vector<FrameGraphImage>& sampled, std::function<void(IRecordingCommandBuffer&)>) override;
+	void addPass(IRenderPass&, FrameGraphImage color, FrameGraphImage depth, const std::vector<FrameGraphImage>& sampled, std::function<void(IRecordingCommandBuffer&)>) override;
+
+	void compile() override;
+	IImageResource& getImage(FrameGraphImage) override;
+	SubmissionHandle execute(IGraphicsQueue&, const std::vector<SubmissionHandle>& waitFor = {}) override;
+
+private:
+	struct Image
+	{
+		ImageResource* resource = nullptr;	//<-- null for swapchain images, which change every frame
+		SwapChain* swapchain = nullptr;
+		bool swapchainDepth = false;	//<-- the depth buffer of the swapchain's current image, rather than the image itself
+		bool isTransient = false;
+		std::unique_ptr<ImageResource> transient;	//<-- created by compile
+		vk::Format format;
+		vk::Extent3D extent;
+		uint32_t aliasOf = UINT32_MAX;	//<-- transient image that used the memory before this one in the same frame
+	};
+
+	struct Pass
+	{
+		RenderPass* renderPass;
+		FrameGraphImage color;
+		FrameGraphImage depth;
+		std::vector<FrameGraphImage> sampled;
+		std::function<void(IRecordingCommandBuffer&)> record;
+		vk::UniqueFramebuffer framebuffer;	//<-- not created for passes rendering to the swapchain
+	};
+
+	// How an image was last used in the command buffer being recorded.
+	struct ImageState
+	{
+		vk::ImageLayout layout;
+		vk::PipelineStageFlags stages;
+		vk::AccessFlags access;
+	};
+
+	// Command buffers are reused once their last submission is complete.
+	struct Recording
+	{
+		std::unique_ptr<CommandBuffer> commandBuffer;
+		SubmissionHandle submission;
+	};
+
+	FrameGraphImage addImage(Image&&);
+	void checkNotCompiled() const;
+	void checkImage(FrameGraphImage) const;
+	void sortPasses();
+	void createTransientImages();
+	void createFramebuffers();
+	ImageResource& resolve(FrameGraphImage) const;
+	Recording& takeRecording();
+	void use(FrameGraphImage, vk::ImageLayout, vk::PipelineStageFlags, vk::AccessFlags);
+	void recordBarriers(CommandBuffer&);
+
+	const Device& m_device;
+	int m_queueFamilyIndex;
+
+	std::vector<Image> m_images;
+	std::vector<Pass> m_passes;
+	std::vector<size_t> m_order;	//<-- indices of m_passes in execution order
+	std::vector<MemoryAllocation> m_transientMemory;	//<-- shared by transient images whose passes don't overlap
+	bool m_compiled = false;
+
+	std::vector<Recording> m_recordings;
+
+	std::vector<ImageState> m_states;	//<-- scratch space for execute
+	std::vector<vk::ImageMemoryBarrier> m_vkBarriers;
+	vk::PipelineStageFlags m_vkBarrierSrcStages;
+	vk::PipelineStageFlags m_vkBarrierDstStages;
+};
@@ -1,4 +1,4 @@
-#include <iterator>
+#include <limits>
 #include "standard_header.hpp"
 #include "graphics_queue.hpp"
 #include "swap_chain.hpp"
@@ -7,150 +7,300 @@
 #include "image_resource.hpp"
 #include "image_resource.impl"
 
-void GraphicsQueue::submitCommands(const std::vector<std::reference_wrapper<ICommandBuffer>>& commandBuffers)
+SubmissionHandle GraphicsQueue::submitCommands(const std::vector<std::reference_wrapper<ICommandBuffer>>& commandBuffers, const std::vector<SubmissionHandle>& waitFor)
 {
 	//m_vkGraphicsQueue.waitIdle();
-	std::vector<vk::Semaphore> semaphores = { *m_vkRenderFinishSemaphore};
-	std::vector<vk::CommandBuffer> vkCommandBuffers;
-	vkCommandBuffers.reserve(commandBuffers.size());
+	// Pending staging copies must be submitted before the commands using the uploaded data.
+	m_device.flushStagingRings();
+
+	// Reuses the capacity of earlier submissions.
+	m_vkCommandBuffers.clear();
+	m_vkWaitSemaphores.clear();
+	m_vkWaitStages.clear();
+	m_waitValues.clear();
+
+	// Earlier submissions on this queue are waited for with a barrier. Submissions on other queues are waited for on
+	// their timeline semaphore, or on the host if the device has no timeline semaphores.
+	auto needsWaitBarrier = false;
+	for (auto& handle : waitFor) {
+		if (handle.isComplete()) {
+			continue;
+		}
 
-	for (auto& commandBuffer : commandBuffers) {
-		vkCommandBuffers.emplace_back(static_cast<vk::CommandBuffer>(static_cast<CommandBuffer&>(commandBuffer.get())));
-	}
+		if (handle.m_queue == this) {
+			needsWaitBarrier = true;
+			continue;
+		}
 
-	vk::SubmitInfo submitInfo = {};
-	submitInfo.setCommandBufferCount(vkCommandBuffers.size())
-		.setPCommandBuffers(vkCommandBuffers.data())
-		.setSignalSemaphoreCount(semaphores.size())
-		.setPSignalSemaphores(semaphores.data());
-
-	int fenceIndex = -1;
-	for (auto i = 0; i < m_vkFences.size(); ++i) {
-		if (m_device.m_vkDevice->getFenceStatus(*m_vkFences[i]) == vk::Result::eSuccess) {
-			fenceIndex = i;
-			break;
+		auto& otherQueue = static_cast<GraphicsQueue&>(*handle.m_queue);
+		auto semaphore = otherQueue.m_submissions.getTimelineSemaphore();
+		if (semaphore) {
+			m_vkWaitSemaphores.push_back(semaphore);
+			m_vkWaitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+			m_waitValues.push_back(handle.m_id);
+		}
+		else {
+			handle.wait();
 		}
 	}
 
-	if (fenceIndex == -1) {
-		fenceIndex = m_vkFences.size();
-		m_vkFences.emplace_back(std::move(m_device.m_vkDevice->createFenceUnique({})));
+	if (needsWaitBarrier) {
+		m_vkCommandBuffers.push_back(*m_vkWaitBarrier);
+	}
+	for (auto& commandBuffer : commandBuffers) {
+		m_vkCommandBuffers.emplace_back(static_cast<vk::CommandBuffer>(static_cast<CommandBuffer&>(commandBuffer.get())));
 	}
 
-	auto& fence = m_vkFences[fenceIndex];
-	m_device.m_vkDevice->resetFences({*fence});	//<-- possible bug: newly created fences might not like to be reset.
+	vk::SubmitInfo submitInfo = {};
+	submitInfo.setWaitSemaphoreCount(m_vkWaitSemaphores.size())
+		.setPWaitSemaphores(m_vkWaitSemaphores.data())
+		.setPWaitDstStageMask(m_vkWaitStages.data())
+		.setCommandBufferCount(m_vkCommandBuffers.size())
+		.setPCommandBuffers(m_vkCommandBuffers.data());
+
+	uint64_t submission;
+	{
+		std::lock_guard<std::mutex> queueLock(m_graphicsQueueMutex);
+		submission = m_submissions.submit(m_vkGraphicsQueue, submitInfo, m_waitValues.data());
+	}
 
-	//TODO: Test if this works with several command buffers using the same resources. - Brandborg
+	// A resource is in use until its latest submission is complete. Command buffers keep their resources, so they
+	// are marked again if the command buffer is submitted again.
 	for (auto& cmd : commandBuffers) {
-		CommandBuffer& commandBuffer = (CommandBuffer&)cmd.get();
-		std::merge(																	// Merge ..
-			ITERATE(m_submittedResources),											// .. this ..
-			ITERATE(commandBuffer.m_resourcesInUse),								// .. and this ..
-			std::inserter(m_submittedResources, m_submittedResources.begin()));		// .. into that
-		commandBuffer.m_resourcesInUse.clear();
-	}
+		auto& commandBuffer = static_cast<CommandBuffer&>(cmd.get());
+		for (auto resource : commandBuffer.m_resourcesInUse) {
+			resource->m_submissionPool = &m_submissions;
+			resource->m_lastSubmission = submission;
+		}
 
-	for (auto& resource : m_submittedResources) {
-		resource->m_vkFence = &(*fence);
+		commandBuffer.markSubmitted(m_submissions, submission, m_frames.size());
+		for (auto subCommandBuffer : commandBuffer.m_subCommandBuffersInUse) {
+			subCommandBuffer->markSubmitted(m_submissions, submission, m_frames.size());
+		}
 	}
 
-	m_vkGraphicsQueue.submit(submitInfo, *fence);
+	return makeSubmissionHandle(submission);
 }
 
-void GraphicsQueue::present(ISwapchain& swapchain)
+bool GraphicsQueue::isSubmissionComplete(uint64_t id)
 {
-	auto& internalSwapChain = dynamic_cast<SwapChain&>(swapchain);
-	//m_vkPresentQueue.waitIdle();
+	return m_submissions.isComplete(id);
+}
 
-	std::set<ImageResource*> imageResources;
-	imageResources.emplace(&internalSwapChain.m_colorResources[internalSwapChain.m_currentFramebufferIndex]);
+bool GraphicsQueue::waitSubmission(uint64_t id, uint64_t timeoutNanoseconds)
+{
+	return m_submissions.wait(id, timeoutNanoseconds);
+}
 
-	// Find image resources from the submitted resources 
-	for (auto& resource : m_submittedResources) {
-		if (typeid(*resource) == typeid(ImageResource)) {
-			auto imageResource = reinterpret_cast<ImageResource*>(resource);
-			imageResources.emplace(imageResource);
-		}
+// Nothing here waits for the GPU, unless framesInFlight frames are already queued. The frame is presented once its
+// work finishes, and the next image is acquired without waiting for the presentation engine to return it.
+void GraphicsQueue::present(ISwapchain& swapchain)
+{
+	auto& internalSwapChain = dynamic_cast<SwapChain&>(swapchain);
+	if (internalSwapChain.m_isOutOfDate) {
+		PAPAGO_ERROR("present(...) called with an out of date swapchain, it has to be recreated!");
+	}
+	if (internalSwapChain.isOffscreen()) {
+		presentOffscreen(internalSwapChain);
+		return;
 	}
 
-	transitionImageResources<vk::ImageLayout::eGeneral, vk::ImageLayout::ePresentSrcKHR>(
-		m_device.m_internalCommandBuffer,
-		m_device.m_vkInternalQueue,
-		imageResources
-		);
+	auto& frame = m_frames[m_frameIndex];
+	m_device.flushStagingRings();
+
+	// The swapchain image is made presentable by the submission that ends the frame. It can't be folded into the last
+	// submitCommands of the frame, as the queue only learns which submission was the last once present() is called,
+	// and renderFinished has to be signaled after the transition.
+	auto& commandBuffer = *frame.presentCommandBuffer;
+	commandBuffer.reset(vk::CommandBufferResetFlags());
+	commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	internalSwapChain.m_colorResources[internalSwapChain.m_currentFramebufferIndex].transition<vk::ImageLayout::eGeneral, vk::ImageLayout::ePresentSrcKHR>(
+		commandBuffer, 
+		vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite, 
+		vk::AccessFlagBits::eMemoryRead);
+	commandBuffer.end();
+
+	// Marks the end of the frame, after everything submitted for it.
+	vk::SubmitInfo submitInfo = {};
+	submitInfo.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer)
+		.setSignalSemaphoreCount(1)
+		.setPSignalSemaphores(&*frame.renderFinished);
+	{
+		std::lock_guard<std::mutex> queueLock(m_graphicsQueueMutex);
+		frame.lastSubmission = m_submissions.submit(m_vkGraphicsQueue, submitInfo);
+	}
 
-	std::vector<vk::Semaphore> semaphores = { *m_vkRenderFinishSemaphore };
 	std::vector<vk::SwapchainKHR> swapchains = { static_cast<vk::SwapchainKHR>(internalSwapChain) };
 
 	vk::PresentInfoKHR presentInfo = {};
-	presentInfo.setWaitSemaphoreCount(semaphores.size())
-		.setPWaitSemaphores(semaphores.data())
+	presentInfo.setWaitSemaphoreCount(1)
+		.setPWaitSemaphores(&*frame.renderFinished)
 		.setSwapchainCount(1)
 		.setPSwapchains(swapchains.data())
 		.setPImageIndices(&internalSwapChain.m_currentFramebufferIndex);
 
-	auto res = m_vkPresentQueue.presentKHR(presentInfo);
+	// The semaphore is waited for even if the presentation is rejected, so the frame can be reused either way.
+	auto result = vk::Result::eErrorOutOfDateKHR;
+	try {
+		std::lock_guard<std::mutex> queueLock(m_presentQueueMutex);
+		result = m_vkPresentQueue.presentKHR(presentInfo);
+	}
+	catch (const vk::OutOfDateKHRError&) {}
 
-	//TODO: find a better way to know when ImageResources can safely be transitioned back to eGeneral layout, Fences??
-	m_vkPresentQueue.waitIdle();
+	m_frameIndex = (m_frameIndex + 1) % m_frames.size();
+	if (result == vk::Result::eErrorOutOfDateKHR) {
+		internalSwapChain.m_isOutOfDate = true;
+		return;
+	}
 
-	transitionImageResources<vk::ImageLayout::ePresentSrcKHR, vk::ImageLayout::eGeneral>(
-		m_device.m_internalCommandBuffer,
-		m_device.m_vkInternalQueue,
-		imageResources
-		);
+	internalSwapChain.m_isSuboptimal |= result == vk::Result::eSuboptimalKHR;
+	acquireNextImage(internalSwapChain);
+}
 
-	m_submittedResources.clear();
-	//TODO: find some way to not create new fences every present.
+// There is no presentation engine to hand the image to. The frame still ends with a submission, so present() keeps at
+// most framesInFlight frames queued, and the writes of the frame are made visible to later downloads of the image.
+void GraphicsQueue::presentOffscreen(SwapChain& swapchain)
+{
+	auto& frame = m_frames[m_frameIndex];
+	m_device.flushStagingRings();
+
+	auto& commandBuffer = *frame.presentCommandBuffer;
+	commandBuffer.reset(vk::CommandBufferResetFlags());
+	commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(),
+		{ vk::MemoryBarrier(
+			vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite,
+			vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite) },
+		{},
+		{});
+	commandBuffer.end();
 
+	vk::SubmitInfo submitInfo = {};
+	submitInfo.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer);
+	{
+		std::lock_guard<std::mutex> queueLock(m_graphicsQueueMutex);
+		frame.lastSubmission = m_submissions.submit(m_vkGraphicsQueue, submitInfo);
+	}
 
-	vk::UniqueFence fence = m_device.m_vkDevice->createFenceUnique({});
-	auto nextFramebuffer = m_device.m_vkDevice->acquireNextImageKHR(static_cast<vk::SwapchainKHR>(internalSwapChain), 0, {}, *fence).value;
+	m_frameIndex = (m_frameIndex + 1) % m_frames.size();
+	m_submissions.wait(m_frames[m_frameIndex].lastSubmission);
 
-	auto& oldFence = internalSwapChain.m_vkFences[nextFramebuffer];
+	swapchain.m_currentFramebufferIndex = (swapchain.m_currentFramebufferIndex + 1) % swapchain.m_colorResources.size();
+}
 
-	/*
-	if(*oldFence != vk::Fence() && m_device.m_vkDevice->getFenceStatus(*oldFence) != vk::Result::eSuccess) {
-		m_vkPresentQueue.waitIdle();
+// Waits until the frame that last used the next set of synchronization objects is done, then acquires an image for it.
+// The image is transitioned on the GPU once the presentation engine releases it, before any commands of the frame.
+// The transition is submitted right away instead of with the first submitCommands of the next frame. The swapchain may
+// be recreated or destroyed before then, e.g. when it is suboptimal, which would leave imageAvailable signaled and the
+// transition recorded for an image that no longer exists.
+void GraphicsQueue::acquireNextImage(SwapChain& swapchain)
+{
+	auto& frame = m_frames[m_frameIndex];
+	auto& device = m_device.m_vkDevice;
+
+	m_submissions.wait(frame.lastSubmission);
+
+	auto acquired = vk::ResultValue<uint32_t>(vk::Result::eErrorOutOfDateKHR, 0);
+	try {
+		acquired = device->acquireNextImageKHR(
+			static_cast<vk::SwapchainKHR>(swapchain), 
+			std::numeric_limits<uint64_t>::max(), 
+			*frame.imageAvailable, 
+			vk::Fence());
 	}
-	*/
+	catch (const vk::OutOfDateKHRError&) {}
 
-	oldFence = std::move(fence);
-	internalSwapChain.m_currentFramebufferIndex = nextFramebuffer;
+	// Nothing was acquired, so the semaphore isn't signaled and must not be waited for.
+	if (acquired.result == vk::Result::eErrorOutOfDateKHR) {
+		swapchain.m_isOutOfDate = true;
+		return;
+	}
+	swapchain.m_isSuboptimal |= acquired.result == vk::Result::eSuboptimalKHR;
+	auto nextFramebuffer = acquired.value;
+
+	auto& commandBuffer = *frame.acquireCommandBuffer;
+	commandBuffer.reset(vk::CommandBufferResetFlags());
+	commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	// The image is either presented or never used, and its old content isn't needed either way. The frame renders
+	// into it and may clear or copy into it.
+	swapchain.m_colorResources[nextFramebuffer].transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral>(
+		commandBuffer,
+		vk::AccessFlags(),
+		vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite);
+	commandBuffer.end();
+
+	vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+	vk::SubmitInfo submitInfo = {};
+	submitInfo.setWaitSemaphoreCount(1)
+		.setPWaitSemaphores(&*frame.imageAvailable)
+		.setPWaitDstStageMask(&waitStage)
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer);
+	std::lock_guard<std::mutex> queueLock(m_graphicsQueueMutex);
+	m_vkGraphicsQueue.submit(submitInfo, vk::Fence());
+
+	swapchain.m_currentFramebufferIndex = nextFramebuffer;
 }
 
 
-GraphicsQueue::GraphicsQueue(const Device& device, int graphicsQueueIndex, int presentQueueIndex)
-	: m_device(device)
+GraphicsQueue::GraphicsQueue(const Device& device, int graphicsQueueIndex, int presentQueueIndex, size_t framesInFlight)
+	: m_submissions(*device.m_vkDevice, device.m_capabilities.timelineSemaphore)
+	, m_vkGraphicsQueue(device.m_vkDevice->getQueue(graphicsQueueIndex, 0))
+	, m_vkPresentQueue(device.m_vkDevice->getQueue(presentQueueIndex, 0))
+	, m_graphicsQueueMutex(device.getQueueMutex(m_vkGraphicsQueue))
+	, m_presentQueueMutex(device.getQueueMutex(m_vkPresentQueue))
+	, m_device(device)
 {
-	m_vkGraphicsQueue = device.m_vkDevice->getQueue(graphicsQueueIndex, 0);
-	m_vkPresentQueue = device.m_vkDevice->getQueue(presentQueueIndex, 0);
+	m_vkCommandPool = device.m_vkDevice->createCommandPoolUnique(vk::CommandPoolCreateInfo()
+		.setQueueFamilyIndex(graphicsQueueIndex)
+		.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
 
-	createSemaphores(device.m_vkDevice);
+	createFrames(device.m_vkDevice, framesInFlight);
+	recordWaitBarrier(device.m_vkDevice);
 }
 
-void GraphicsQueue::createSemaphores(const vk::UniqueDevice &device)
+// The semaphores and command buffers of queued frames must outlive them.
+GraphicsQueue::~GraphicsQueue()
 {
-	m_vkRenderFinishSemaphore = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+	m_submissions.wait(m_submissions.getLastSubmittedId());
 }
 
-template<vk::ImageLayout from, vk::ImageLayout to>
-inline void GraphicsQueue::transitionImageResources(const CommandBuffer& commandBuffer, const vk::Queue& queue, std::set<ImageResource*> resources) {
-	auto commandBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
-	commandBuffer->begin(commandBeginInfo);
-	//Transition submitted ImageResources to ePresentSrcKHR:
-	for (auto& resource : resources) {
-		resource->transition<from, to>(commandBuffer);
+void GraphicsQueue::createFrames(const vk::UniqueDevice &device, size_t framesInFlight)
+{
+	auto commandBuffers = device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo()
+		.setCommandPool(*m_vkCommandPool)
+		.setLevel(vk::CommandBufferLevel::ePrimary)
+		.setCommandBufferCount(static_cast<uint32_t>(framesInFlight * 2)));
+
+	m_frames.resize(framesInFlight);
+	for (size_t i = 0; i < framesInFlight; ++i) {
+		m_frames[i].imageAvailable = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+		m_frames[i].renderFinished = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+		m_frames[i].acquireCommandBuffer = std::move(commandBuffers[i * 2]);
+		m_frames[i].presentCommandBuffer = std::move(commandBuffers[i * 2 + 1]);
 	}
+}
 
-	commandBuffer->end();
-
-	vk::SubmitInfo submitInfo = {};
-	submitInfo.setCommandBufferCount(1)
-		.setPCommandBuffers(&*commandBuffer);
-	queue.submit(submitInfo, vk::Fence());
-
-	queue.waitIdle();
-
-	commandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+// Recorded once and submitted in front of the command buffers of every submission that waits for an earlier one.
+void GraphicsQueue::recordWaitBarrier(const vk::UniqueDevice& device)
+{
+	m_vkWaitBarrier = std::move(device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo()
+		.setCommandPool(*m_vkCommandPool)
+		.setLevel(vk::CommandBufferLevel::ePrimary)
+		.setCommandBufferCount(1))[0]);
+
+	m_vkWaitBarrier->begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse));
+	m_vkWaitBarrier->pipelineBarrier(
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(),
+		{ vk::MemoryBarrier(vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite) },
+		{},
+		{});
+	m_vkWaitBarrier->end();
 }
@@ -1,33 +1,61 @@
 #pragma once
 #include <vector>
-#include <set>
+#include <mutex>
 #include "resource.hpp"
 #include "igraphics_queue.hpp"
+#include "submission_pool.hpp"
 
 class Device;
 class CommandBuffer;
 class ISwapChain;
+class SwapChain;
 class ICommandBuffer;
 class ImageResource;
 
 class GraphicsQueue : public IGraphicsQueue
 {
 public:
-	GraphicsQueue(const Device&, int graphicsQueueIndex, int presentQueueIndex);
+	GraphicsQueue(const Device&, int graphicsQueueIndex, int presentQueueIndex, size_t framesInFlight);
+	~GraphicsQueue();
 	
 	void present(ISwapchain& swapchain) override;
-	void submitCommands(const std::vector<std::reference_wrapper<ICommandBuffer>>&) override;
+	SubmissionHandle submitCommands(
+		const std::vector<std::reference_wrapper<ICommandBuffer>>&,
+		const std::vector<SubmissionHandle>& waitFor = {}) override;
+
+	SubmissionPool m_submissions;
+protected:
+	bool isSubmissionComplete(uint64_t id) override;
+	bool waitSubmission(uint64_t id, uint64_t timeoutNanoseconds) override;
 private:
-	void createSemaphores(const vk::UniqueDevice&);
+	// The synchronization objects of one frame. They are reused once the frame's last submission is complete.
+	struct Frame
+	{
+		vk::UniqueSemaphore imageAvailable;	//<-- signaled when the acquired swapchain image can be written
+		vk::UniqueSemaphore renderFinished;	//<-- signaled when the frame can be presented
+		uint64_t lastSubmission = 0;		//<-- the submission ending the frame, see SubmissionPool
+		vk::UniqueCommandBuffer acquireCommandBuffer;
+		vk::UniqueCommandBuffer presentCommandBuffer;
+	};
 
-	template<vk::ImageLayout from, vk::ImageLayout to>
-	static void transitionImageResources(const CommandBuffer&, const vk::Queue&, std::set<ImageResource*> resources);
+	void createFrames(const vk::UniqueDevice&, size_t framesInFlight);
+	void recordWaitBarrier(const vk::UniqueDevice&);
+	void acquireNextImage(SwapChain&);
+	void presentOffscreen(SwapChain&);
 
 	vk::Queue m_vkGraphicsQueue;
 	vk::Queue m_vkPresentQueue;
-	vk::UniqueSemaphore m_vkRenderFinishSemaphore;
+	std::mutex& m_graphicsQueueMutex;	//<-- see Device::getQueueMutex, may be the same mutex as the one below
+	std::mutex& m_presentQueueMutex;
 	const Device& m_device;
-	std::vector<vk::UniqueFence> m_vkFences;
+	vk::UniqueCommandPool m_vkCommandPool;
+	std::vector<Frame> m_frames;
+	size_t m_frameIndex = 0;
+
+	vk::UniqueCommandBuffer m_vkWaitBarrier;	//<-- orders a submission after everything submitted before it on the queue
 
-	std::set<Resource*> m_submittedResources;
+	std::vector<vk::CommandBuffer> m_vkCommandBuffers;	//<-- scratch space for submitCommands
+	std::vector<vk::Semaphore> m_vkWaitSemaphores;
+	std::vector<vk::PipelineStageFlags> m_vkWaitStages;
+	std::vector<uint64_t> m_waitValues;
 };
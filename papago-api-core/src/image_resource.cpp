@@ -1,5 +1,6 @@
 #include "standard_header.hpp"
 #include "image_resource.hpp"
+#include "submission_pool.hpp"
 #include "device.hpp"
 #include "ibuffer_resource.hpp"
 #include "image_resource.impl"
@@ -10,6 +11,8 @@ ImageResource::ImageResource(ImageResource&& other) noexcept
 	, m_vkImageView(std::move(other.m_vkImageView))
 	, m_format(other.m_format)
 	, m_vkExtent(other.m_vkExtent)
+	, m_mipLevels(other.m_mipLevels)
+	, m_vkAttachmentImageView(std::move(other.m_vkAttachmentImageView))
 	, m_device(other.m_device)
 	, m_vkAspectFlags(other.m_vkAspectFlags)
 {
@@ -27,40 +30,10 @@ ImageResource::~ImageResource()
 	}
 }
 
-void ImageResource::upload(const std::vector<char>& data)
+std::vector<vk::BufferImageCopy> ImageResource::getUploadRegions(uint32_t mipLevel) const
 {
-	//Transition image so host can upload
-	auto& commandBuffer = m_device.m_internalCommandBuffer;
-	vk::CommandBufferBeginInfo beginInfo = {};
-	beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	commandBuffer->begin(beginInfo);
-	
-
-
-	transition<vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferDstOptimal>(commandBuffer);
-	
-
-	//Do the actual uploading
-	vk::BufferCreateInfo bufferInfo = {};
-	bufferInfo.setSize(data.size())
-		.setUsage(vk::BufferUsageFlagBits::eTransferSrc);
-
-	auto buffer = m_vkDevice->createBufferUnique(bufferInfo);
-
-	auto memoryRequirements = m_vkDevice->getBufferMemoryRequirements(*buffer);
-	auto memoryType = findMemoryType(m_device.m_vkPhysicalDevice, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
-	vk::MemoryAllocateInfo allocateInfo = {};
-	allocateInfo.setAllocationSize(memoryRequirements.size)
-		.setMemoryTypeIndex(memoryType);
-
-	auto memory = m_vkDevice->allocateMemoryUnique(allocateInfo);
-
-	m_device.m_vkDevice->bindBufferMemory(*buffer, *memory, 0);
-	auto map = m_vkDevice->mapMemory(*memory, 0, VK_WHOLE_SIZE);
-	memcpy(map, data.data(), data.size());
-	m_vkDevice->unmapMemory(*memory);
-
 	std::vector<vk::BufferImageCopy> regions;
+	auto extent = getMipExtent(mipLevel);
 	
 	if (m_vkAspectFlags & vk::ImageAspectFlagBits::eColor) {
 		vk::BufferImageCopy region;
@@ -68,11 +41,11 @@ void ImageResource::upload(const std::vector<char>& data)
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = m_vkAspectFlags;
-		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.mipLevel = mipLevel;
 		region.imageSubresource.baseArrayLayer = 0;
 		region.imageSubresource.layerCount = 1;
 		region.imageOffset = vk::Offset3D{ 0,0,0 };
-		region.imageExtent = m_vkExtent;
+		region.imageExtent = extent;
 
 		regions.push_back(region);
 	}
@@ -82,112 +55,215 @@ void ImageResource::upload(const std::vector<char>& data)
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eDepth;
-		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.mipLevel = mipLevel;
 		region.imageSubresource.baseArrayLayer = 0;
 		region.imageSubresource.layerCount = 1;
 		region.imageOffset = vk::Offset3D{ 0,0,0 };
-		region.imageExtent = m_vkExtent;
+		region.imageExtent = extent;
 
 		regions.push_back(region);
 	}
 
 	if (m_vkAspectFlags & vk::ImageAspectFlagBits::eStencil) {
 		vk::BufferImageCopy region;
-		region.bufferOffset = m_vkExtent.width * m_vkExtent.height * sizeof(float);
+		region.bufferOffset = extent.width * extent.height * sizeof(float);
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eStencil;
-		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.mipLevel = mipLevel;
 		region.imageSubresource.baseArrayLayer = 0;
 		region.imageSubresource.layerCount = 1;
 		region.imageOffset = vk::Offset3D{ 0, 0 ,0 };
-		region.imageExtent = m_vkExtent;
+		region.imageExtent = extent;
 
 		regions.push_back(region);
 	}
 
-	commandBuffer->copyBufferToImage(*buffer, m_vkImage, vk::ImageLayout::eTransferDstOptimal, regions.size(), regions.data());
+	return regions;
+}
 
-	//Transition to eGeneral, as that is our "default" layout
-	transition<vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral>(commandBuffer);
-	commandBuffer->end();
+// Uploads the first mip level and generates the rest of the chain from it. Formats that can't be blitted, like the
+// block compressed ones, need every level uploaded on its own, or the sampler would read undefined levels.
+void ImageResource::upload(const std::vector<char>& data)
+{
+	auto regions = getUploadRegions(0);
+	auto generateMipmaps = m_mipLevels > 1;
+	if (generateMipmaps && !canGenerateMipmaps()) {
+		PAPAGO_ERROR("The mip chain of this format can't be generated, upload every level with upload(data, mipLevel)!");
+	}
 
-	//execute everything
-	vk::SubmitInfo submitInfo = {};
-	submitInfo.setCommandBufferCount(1)
-		.setPCommandBuffers(&*commandBuffer);
+	// The copy is recorded into the staging ring's current batch, which is submitted together with the next graphics submission.
+	m_device.m_stagingRing->upload(data.data(), data.size(), [&](vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::DeviceSize offset) {
+		for (auto& region : regions) {
+			region.bufferOffset += offset;
+		}
 
-	m_device.m_vkInternalQueue.submit(submitInfo, vk::Fence());
-	m_device.m_vkInternalQueue.waitIdle();
+		transition<vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferDstOptimal>(commandBuffer, vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eTransferWrite);
+		commandBuffer.copyBufferToImage(buffer, m_vkImage, vk::ImageLayout::eTransferDstOptimal, regions);
 
-	//cleanup
-	commandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+		if (generateMipmaps) {
+			recordMipmapGeneration(commandBuffer);
+		}
+		else {
+			//Transition to eGeneral, as that is our "default" layout
+			transition<vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral>(commandBuffer, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead);
+		}
+	});
 }
 
-std::vector<char> ImageResource::download()
+// Uploads a single mip level, e.g. from a file with precomputed mipmaps. The other levels are left untouched.
+void ImageResource::upload(const std::vector<char>& data, uint32_t mipLevel)
 {
+	upload(data.data(), data.size(), mipLevel);
+}
 
-	//Transition image so host can upload
-	auto& commandBuffer = m_device.m_internalCommandBuffer;
-	vk::CommandBufferBeginInfo beginInfo = {};
-	beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	commandBuffer->begin(beginInfo);
-	transition<vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal>(commandBuffer);
-
-	auto bufferSize = m_size;
-	//if image came from swapchain (i.e. m_image == 0)
-	if (bufferSize == 0) {
-		auto memoryRequirements = m_vkDevice->getImageMemoryRequirements(m_vkImage);
-		bufferSize = memoryRequirements.size;
+void ImageResource::upload(const char* data, size_t size, uint32_t mipLevel)
+{
+	if (mipLevel >= m_mipLevels) {
+		PAPAGO_ERROR("Mip level is out of range!");
 	}
 
-	vk::BufferCreateInfo bufferInfo = {};
-	bufferInfo.setSize(bufferSize)
-		.setUsage(vk::BufferUsageFlagBits::eTransferDst);
+	auto regions = getUploadRegions(mipLevel);
 
-	auto buffer = m_vkDevice->createBufferUnique(bufferInfo);
+	m_device.m_stagingRing->upload(data, size, [&](vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::DeviceSize offset) {
+		for (auto& region : regions) {
+			region.bufferOffset += offset;
+		}
 
-	auto memoryRequirements = m_vkDevice->getBufferMemoryRequirements(*buffer);
-	auto memoryType = findMemoryType(m_device.m_vkPhysicalDevice, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
-	vk::MemoryAllocateInfo allocateInfo = {};
-	allocateInfo.setAllocationSize(memoryRequirements.size)
-		.setMemoryTypeIndex(memoryType);
+		recordLevelTransition(commandBuffer, mipLevel, 1, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eTransferWrite);
+		commandBuffer.copyBufferToImage(buffer, m_vkImage, vk::ImageLayout::eTransferDstOptimal, regions);
+		recordLevelTransition(commandBuffer, mipLevel, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead);
+	});
+}
 
-	auto memory = m_vkDevice->allocateMemoryUnique(allocateInfo);
+bool ImageResource::canGenerateMipmaps() const
+{
+	auto features = m_device.m_vkPhysicalDevice.getFormatProperties(m_format).optimalTilingFeatures;
+	auto blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst;
+	return (features & blitFeatures) == blitFeatures;
+}
 
-	m_device.m_vkDevice->bindBufferMemory(*buffer, *memory, 0);
+// Expects every level in eTransferDstOptimal with level 0 written. Each level is blitted from the one above it,
+// which is made a transfer source first, and every level ends up in eGeneral.
+void ImageResource::recordMipmapGeneration(vk::CommandBuffer commandBuffer)
+{
+	auto features = m_device.m_vkPhysicalDevice.getFormatProperties(m_format).optimalTilingFeatures;
+	auto filter = features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear ? vk::Filter::eLinear : vk::Filter::eNearest;
 
-	vk::BufferImageCopy region;
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = m_vkAspectFlags; //TODO: subresource.aspectMask can only have 1 bit set. Handle case where *this is a depth/stencil buffer. -AM
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = vk::Offset3D{ 0,0,0 };
-	region.imageExtent = m_vkExtent;
+	auto width = static_cast<int32_t>(m_vkExtent.width);
+	auto height = static_cast<int32_t>(m_vkExtent.height);
 
-	commandBuffer->copyImageToBuffer(m_vkImage, vk::ImageLayout::eTransferSrcOptimal, *buffer, { region });
-	transition<vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral>(commandBuffer);
+	for (uint32_t level = 1; level < m_mipLevels; ++level) {
+		recordLevelTransition(commandBuffer, level - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead);
 
-	commandBuffer->end();
+		auto nextWidth = std::max(width / 2, 1);
+		auto nextHeight = std::max(height / 2, 1);
 
-	//execute everything
-	vk::SubmitInfo submitInfo = {};
-	submitInfo.setCommandBufferCount(1)
-		.setPCommandBuffers(&*commandBuffer);
+		vk::ImageBlit blit;
+		blit.srcSubresource = vk::ImageSubresourceLayers(m_vkAspectFlags, level - 1, 0, 1);
+		blit.srcOffsets[0] = vk::Offset3D{ 0, 0, 0 };
+		blit.srcOffsets[1] = vk::Offset3D{ width, height, 1 };
+		blit.dstSubresource = vk::ImageSubresourceLayers(m_vkAspectFlags, level, 0, 1);
+		blit.dstOffsets[0] = vk::Offset3D{ 0, 0, 0 };
+		blit.dstOffsets[1] = vk::Offset3D{ nextWidth, nextHeight, 1 };
 
-	m_device.m_vkInternalQueue.submit(submitInfo, vk::Fence());
-	m_device.m_vkInternalQueue.waitIdle();
+		commandBuffer.blitImage(m_vkImage, vk::ImageLayout::eTransferSrcOptimal, m_vkImage, vk::ImageLayout::eTransferDstOptimal, { blit }, filter);
 
-	//cleanup
-	commandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+		width = nextWidth;
+		height = nextHeight;
+	}
+
+	recordLevelTransition(commandBuffer, 0, m_mipLevels - 1, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eMemoryRead);
+	recordLevelTransition(commandBuffer, m_mipLevels - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead);
+}
+
+void ImageResource::recordLevelTransition(
+	vk::CommandBuffer commandBuffer, 
+	uint32_t baseMipLevel, 
+	uint32_t levelCount, 
+	vk::ImageLayout oldLayout, 
+	vk::ImageLayout newLayout, 
+	vk::AccessFlags srcAccessFlags, 
+	vk::AccessFlags dstAccessFlags)
+{
+	auto imageMemoryBarrier = vk::ImageMemoryBarrier(
+		srcAccessFlags,
+		dstAccessFlags,
+		oldLayout,
+		newLayout,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		m_vkImage,
+		{ m_vkAspectFlags, baseMipLevel, levelCount, 0, 1 });
+
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(),
+		{},
+		{},
+		{ imageMemoryBarrier });
+}
+
+// The previous content is discarded, so the image doesn't have to be acquired from the graphics queue before the copy.
+// Only the first mip level is uploaded, as a transfer queue can't blit the rest of the chain.
+uint64_t ImageResource::uploadAsync(StagingRing& stagingRing, const std::vector<char>& data)
+{
+	if (m_mipLevels > 1) {
+		PAPAGO_ERROR("Asynchronous uploads only support images with a single mip level!");
+	}
+
+	auto regions = getUploadRegions(0);
+	auto release = vk::ImageMemoryBarrier(
+		vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eMemoryRead,
+		vk::ImageLayout::eTransferDstOptimal,
+		vk::ImageLayout::eGeneral,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		m_vkImage,
+		{ m_vkAspectFlags, 0, 1, 0, 1 });
+
+	return stagingRing.upload(data.data(), data.size(), [&](vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::DeviceSize offset) {
+		for (auto& region : regions) {
+			region.bufferOffset += offset;
+		}
+
+		transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal>(commandBuffer, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite);
+		commandBuffer.copyBufferToImage(buffer, m_vkImage, vk::ImageLayout::eTransferDstOptimal, regions);
+	}, {}, { release });
+}
+
+std::vector<char> ImageResource::download()
+{
+	auto bufferSize = m_size;
+	//if image came from swapchain (i.e. m_image == 0)
+	if (bufferSize == 0) {
+		auto memoryRequirements = m_vkDevice->getImageMemoryRequirements(m_vkImage);
+		bufferSize = memoryRequirements.size;
+	}
 
 	std::vector<char> result(bufferSize);
-	auto mappedMemory = m_vkDevice->mapMemory(*memory, 0, VK_WHOLE_SIZE);
-	memcpy(result.data(), mappedMemory, bufferSize);
-	m_vkDevice->unmapMemory(*memory);
+
+	// Only waits for the batch containing this copy, not for the whole queue.
+	m_device.m_stagingRing->readback(bufferSize, [&](vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::DeviceSize offset) {
+		transition<vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal>(commandBuffer, vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eTransferRead);
+
+		vk::BufferImageCopy region;
+		region.bufferOffset = offset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = m_vkAspectFlags; //TODO: subresource.aspectMask can only have 1 bit set. Handle case where *this is a depth/stencil buffer. -AM
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = vk::Offset3D{ 0,0,0 };
+		region.imageExtent = m_vkExtent;
+
+		commandBuffer.copyImageToBuffer(m_vkImage, vk::ImageLayout::eTransferSrcOptimal, buffer, { region });
+		transition<vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral>(commandBuffer);
+	}, result.data());
+
 	return result;
 }
 
@@ -206,6 +282,41 @@ Format ImageResource::getFormat() const
 	return  from_vulkan_format(m_format);
 }
 
+uint32_t ImageResource::getMipLevels() const
+{
+	return m_mipLevels;
+}
+
+vk::ImageView ImageResource::getAttachmentView() const
+{
+	return m_vkAttachmentImageView ? *m_vkAttachmentImageView : *m_vkImageView;
+}
+
+vk::ImageSubresourceRange ImageResource::getSubresourceRange() const
+{
+	return { m_vkAspectFlags, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+}
+
+vk::Extent3D ImageResource::getMipExtent(uint32_t mipLevel) const
+{
+	return vk::Extent3D(
+		std::max(m_vkExtent.width >> mipLevel, 1u),
+		std::max(m_vkExtent.height >> mipLevel, 1u),
+		std::max(m_vkExtent.depth >> mipLevel, 1u));
+}
+
+// The full chain goes down to 1x1.
+uint32_t ImageResource::getFullMipLevelCount(vk::Extent3D extent)
+{
+	uint32_t levels = 1;
+	auto size = std::max(extent.width, extent.height);
+	while (size > 1) {
+		size /= 2;
+		++levels;
+	}
+	return levels;
+}
+
 
 ImageResource ImageResource::createDepthResource(
 	const Device& device, 
@@ -230,31 +341,28 @@ ImageResource ImageResource::createDepthResource(
 
 	auto memoryRequirements = device.m_vkDevice->getImageMemoryRequirements(image);
 
-	auto aspectFlags = vk::ImageAspectFlags();
+	return ImageResource(
+		image,
+		device,
+		getDepthStencilAspectFlags(format),
+		format,
+		extent,
+		memoryRequirements);
+}
 
+vk::ImageAspectFlags ImageResource::getDepthStencilAspectFlags(vk::Format format)
+{
 	switch (format) {
 		case vk::Format::eS8Uint:
-			aspectFlags = vk::ImageAspectFlagBits::eStencil;
-			break;
+			return vk::ImageAspectFlagBits::eStencil;
 		case vk::Format::eD32SfloatS8Uint:
 		case vk::Format::eD24UnormS8Uint:
-			aspectFlags = vk::ImageAspectFlagBits::eDepth |  vk::ImageAspectFlagBits::eStencil;
-			break;
+			return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
 		case vk::Format::eD32Sfloat:
-			aspectFlags = vk::ImageAspectFlagBits::eDepth;
-			break;
+			return vk::ImageAspectFlagBits::eDepth;
 		default:
 			PAPAGO_ERROR("Unimplemented depth/stencil format!");
-			break;
 	}
-
-	return ImageResource(
-		image,
-		device,
-		aspectFlags,
-		format,
-		extent,
-		memoryRequirements);
 }
 
 ImageResource ImageResource::createColorResource(
@@ -273,38 +381,23 @@ ImageResource::ImageResource(
 	vk::ImageAspectFlags aspectFlags,
 	vk::Format format,
 	vk::Extent3D extent,
-	vk::MemoryRequirements memoryRequirements)
-	: Resource(device.m_vkPhysicalDevice, device.m_vkDevice, vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible, memoryRequirements)
+	vk::MemoryRequirements memoryRequirements,
+	uint32_t mipLevels)
+	: Resource(*device.m_allocator, device.m_vkDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, memoryRequirements, AllocationKind::eImage)
 	, m_vkImage(image)
 	, m_format(format)
 	, m_vkExtent(extent)
+	, m_mipLevels(mipLevels)
 	, m_device(device)
 	, m_vkAspectFlags(aspectFlags)
 {
-	m_vkDevice->bindImageMemory(m_vkImage, *m_vkMemory, 0);
+	m_vkDevice->bindImageMemory(m_vkImage, m_memory.memory, m_memory.offset);
 
 	createImageView(m_vkDevice, aspectFlags);
 
-	vk::CommandBufferBeginInfo info = {};
-	info.setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
-	m_device.m_internalCommandBuffer->begin(info);
-
-	if (aspectFlags & vk::ImageAspectFlagBits::eDepth) {
-		transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral>(m_device.m_internalCommandBuffer);
-	}
-	else if (aspectFlags & vk::ImageAspectFlagBits::eColor) {
-		transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral>(m_device.m_internalCommandBuffer);
-	}
-	
-	m_device.m_internalCommandBuffer->end();
-
-	vk::SubmitInfo submitInfo = {};
-	submitInfo.setCommandBufferCount(1)
-		.setPCommandBuffers(&*m_device.m_internalCommandBuffer);
-	m_device.m_vkInternalQueue.submit(submitInfo, vk::Fence());
-	m_device.m_vkInternalQueue.waitIdle();
-
-	m_device.m_internalCommandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+	m_device.m_stagingRing->record([this](vk::CommandBuffer commandBuffer) {
+		transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral>(commandBuffer, vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite);
+	});
 	
 	auto clearVector = std::vector<char>(memoryRequirements.size);
 	auto clearFloats = std::vector<float>(m_vkExtent.width * m_vkExtent.height, 1.0f);
@@ -316,7 +409,10 @@ ImageResource::ImageResource(
 		memcpy(clearVector.data() + (clearFloats.size() * sizeof(float)), clearStencil.data(), clearVector.size() - clearFloats.size() * sizeof(float) - 1);
 	}
 	
-	upload(clearVector);
+	// The levels of a chain that can't be generated are all left to the per-level uploads.
+	if (m_mipLevels == 1 || canGenerateMipmaps()) {
+		upload(clearVector);
+	}
 }
 
 // Does NOT allocate memory, this is assumed to already be allocated; but does create a VkImageView.
@@ -325,34 +421,48 @@ ImageResource::ImageResource(vk::Image& image, const Device& device, vk::Format
 	, m_vkImage(std::move(image))
 	, m_format(format)
 	, m_vkExtent(extent)
+	, m_mipLevels(1)
 	, m_device(device)
 	, m_vkAspectFlags(vk::ImageAspectFlagBits::eColor)
 {
 	createImageView(m_vkDevice);
 
-	vk::CommandBufferBeginInfo info = {};
-	info.setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
-	m_device.m_internalCommandBuffer->begin(info);
-	
-	transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral>(m_device.m_internalCommandBuffer);
-
-	m_device.m_internalCommandBuffer->end();
-	vk::SubmitInfo submitInfo = {};
-	submitInfo.setCommandBufferCount(1)
-		.setPCommandBuffers(&*m_device.m_internalCommandBuffer);
-	m_device.m_vkInternalQueue.submit(submitInfo, vk::Fence());
-	m_device.m_vkInternalQueue.waitIdle();
-
-	m_device.m_internalCommandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+	m_device.m_stagingRing->record([this](vk::CommandBuffer commandBuffer) {
+		transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral>(commandBuffer, vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite);
+	});
 
 	auto clearVector = std::vector<char>(m_vkExtent.width * m_vkExtent.height * m_vkExtent.depth * sizeOfFormat(m_format));
 	upload(clearVector);
 }
 
+// Binds memory owned by someone else, e.g. memory shared by the transient images of a frame graph. The image is
+// neither cleared nor transitioned, its owner transitions it from the undefined layout before using it.
+ImageResource::ImageResource(
+	vk::Image& image,
+	const Device& device,
+	vk::ImageAspectFlags aspectFlags,
+	vk::Format format,
+	vk::Extent3D extent,
+	const MemoryAllocation& memory)
+	: Resource(device.m_vkDevice)
+	, m_vkImage(image)
+	, m_format(format)
+	, m_vkExtent(extent)
+	, m_mipLevels(1)
+	, m_device(device)
+	, m_vkAspectFlags(aspectFlags)
+{
+	// The image is owned and destroyed by this resource, the memory is not.
+	m_size = memory.size;
+	m_vkDevice->bindImageMemory(m_vkImage, memory.memory, memory.offset);
+
+	createImageView(m_vkDevice, aspectFlags);
+}
+
 inline bool ImageResource::inUse()
 {
-	return m_vkFence
-		&& m_vkDevice->getFenceStatus(*m_vkFence) == vk::Result::eNotReady;
+	return m_submissionPool
+		&& !m_submissionPool->isComplete(m_lastSubmission);
 }
 
 vk::Format ImageResource::findSupportedFormat(
@@ -382,7 +492,20 @@ void ImageResource::createImageView(const vk::UniqueDevice &device, vk::ImageAsp
 		.setFormat(m_format)
 		.setSubresourceRange(vk::ImageSubresourceRange()
 			.setAspectMask(aspectFlags)
-			.setLevelCount(1)
+			.setLevelCount(m_mipLevels)
 			.setLayerCount(1))
 	);
+
+	// Framebuffer attachments must be single level views.
+	if (m_mipLevels > 1) {
+		m_vkAttachmentImageView = device->createImageViewUnique(vk::ImageViewCreateInfo()
+			.setImage(m_vkImage)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(m_format)
+			.setSubresourceRange(vk::ImageSubresourceRange()
+				.setAspectMask(aspectFlags)
+				.setLevelCount(1)
+				.setLayerCount(1))
+		);
+	}
 }
@@ -5,6 +5,7 @@
 
 class CommandBuffer;
 class Device;
+class StagingRing;
 
 class ImageResource : public Resource, public IImageResource
 {
@@ -14,15 +15,25 @@ public:
 	~ImageResource();
 
 	template<vk::ImageLayout source, vk::ImageLayout destination>
-	void transition(const CommandBuffer&, vk::AccessFlags srcAccessFlags = vk::AccessFlags(), vk::AccessFlags dstAccessFlags = vk::AccessFlags());
+	void transition(const vk::CommandBuffer&, vk::AccessFlags srcAccessFlags = vk::AccessFlags(), vk::AccessFlags dstAccessFlags = vk::AccessFlags());
 
 	void upload(const std::vector<char>& data) override; 
+	void upload(const std::vector<char>& data, uint32_t mipLevel) override;
+	void upload(const char* data, size_t size, uint32_t mipLevel);
+	// Records the upload into stagingRing and releases the image to the ring's handoff queue. Returns the batch id.
+	uint64_t uploadAsync(StagingRing& stagingRing, const std::vector<char>& data);
 
 	std::vector<char> download() override;
 
 	uint32_t getWidth() const override;
 	uint32_t getHeight() const override;
 	Format getFormat() const override;
+	uint32_t getMipLevels() const override;
+
+	// View of the first mip level, for use as a framebuffer attachment.
+	vk::ImageView getAttachmentView() const;
+	// Every mip level and aspect of the image, for barriers.
+	vk::ImageSubresourceRange getSubresourceRange() const;
 
 	ImageResource(
 		vk::Image&,
@@ -30,7 +41,8 @@ public:
 		vk::ImageAspectFlags,
 		vk::Format,
 		vk::Extent3D,
-		vk::MemoryRequirements);
+		vk::MemoryRequirements,
+		uint32_t mipLevels = 1);
 
 	ImageResource(
 		vk::Image&, 
@@ -38,12 +50,22 @@ public:
 		vk::Format,
 		vk::Extent3D);
 
+	ImageResource(
+		vk::Image&,
+		const Device&,
+		vk::ImageAspectFlags,
+		vk::Format,
+		vk::Extent3D,
+		const MemoryAllocation&);
+
 	bool inUse() override;
 
 	vk::Image m_vkImage;
 	vk::UniqueImageView m_vkImageView;
 	vk::Format m_format;
 	vk::Extent3D m_vkExtent;
+	uint32_t m_mipLevels;
+	vk::UniqueImageView m_vkAttachmentImageView;	//<-- only created when the image has more than one mip level
 	vk::UniqueFramebuffer m_vkFramebuffer;
 	static ImageResource createDepthResource(
 		const Device& device,
@@ -62,7 +84,15 @@ public:
 		vk::ImageTiling, 
 		vk::FormatFeatureFlags);
 
+	static uint32_t getFullMipLevelCount(vk::Extent3D);
+	static vk::ImageAspectFlags getDepthStencilAspectFlags(vk::Format);
+
 private:
+	std::vector<vk::BufferImageCopy> getUploadRegions(uint32_t mipLevel) const;
+	vk::Extent3D getMipExtent(uint32_t mipLevel) const;
+	bool canGenerateMipmaps() const;
+	void recordMipmapGeneration(vk::CommandBuffer);
+	void recordLevelTransition(vk::CommandBuffer, uint32_t baseMipLevel, uint32_t levelCount, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::AccessFlags srcAccessFlags, vk::AccessFlags dstAccessFlags);
 	void createImageView(
 		const vk::UniqueDevice&, 
 		vk::ImageAspectFlags = vk::ImageAspectFlagBits::eColor);
@@ -0,0 +1,303 @@
+#include "standard_header.hpp"
+#include "memory_allocator.hpp"
+
+MemoryBlock::MemoryBlock(vk::Device device, vk::DeviceSize size, uint32_t memoryTypeIndex, bool dedicated)
+	: m_vkDevice(device)
+	, m_size(size)
+	, m_memoryTypeIndex(memoryTypeIndex)
+	, m_dedicated(dedicated)
+{
+	m_vkMemory = m_vkDevice.allocateMemory(vk::MemoryAllocateInfo()
+		.setAllocationSize(size)
+		.setMemoryTypeIndex(memoryTypeIndex));
+
+	m_freeRanges[0] = size;
+}
+
+MemoryBlock::~MemoryBlock()
+{
+	if (m_mapped) {
+		m_vkDevice.unmapMemory(m_vkMemory);
+	}
+	m_vkDevice.freeMemory(m_vkMemory);
+}
+
+// First-fit search through the free ranges. The part of a range skipped to satisfy the alignment stays free.
+bool MemoryBlock::allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset)
+{
+	for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it) {
+		auto rangeOffset = it->first;
+		auto rangeSize = it->second;
+		auto alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+		auto padding = alignedOffset - rangeOffset;
+
+		if (padding + size > rangeSize) {
+			continue;
+		}
+
+		m_freeRanges.erase(it);
+		if (padding > 0) {
+			m_freeRanges[rangeOffset] = padding;
+		}
+		if (padding + size < rangeSize) {
+			m_freeRanges[alignedOffset + size] = rangeSize - padding - size;
+		}
+
+		m_usedSize += size;
+		++m_allocationCount;
+		offset = alignedOffset;
+		return true;
+	}
+
+	return false;
+}
+
+void MemoryBlock::free(vk::DeviceSize offset, vk::DeviceSize size)
+{
+	auto it = m_freeRanges.emplace(offset, size).first;
+
+	// merge with the following range
+	auto next = std::next(it);
+	if (next != m_freeRanges.end() && it->first + it->second == next->first) {
+		it->second += next->second;
+		m_freeRanges.erase(next);
+	}
+
+	// merge with the preceding range
+	if (it != m_freeRanges.begin()) {
+		auto previous = std::prev(it);
+		if (previous->first + previous->second == it->first) {
+			previous->second += it->second;
+			m_freeRanges.erase(it);
+		}
+	}
+
+	m_usedSize -= size;
+	--m_allocationCount;
+}
+
+bool MemoryBlock::isEmpty() const
+{
+	return m_usedSize == 0;
+}
+
+vk::DeviceSize MemoryBlock::getUsedSize() const
+{
+	return m_usedSize;
+}
+
+uint32_t MemoryBlock::getAllocationCount() const
+{
+	return m_allocationCount;
+}
+
+vk::DeviceSize MemoryBlock::getLargestFreeRange() const
+{
+	vk::DeviceSize largest = 0;
+	for (auto& range : m_freeRanges) {
+		largest = std::max(largest, range.second);
+	}
+	return largest;
+}
+
+// A VkDeviceMemory can only be mapped once, so every allocation in the block shares one reference counted mapping.
+void* MemoryBlock::map()
+{
+	if (m_mapCount++ == 0) {
+		m_mapped = m_vkDevice.mapMemory(m_vkMemory, 0, VK_WHOLE_SIZE);
+	}
+	return m_mapped;
+}
+
+void MemoryBlock::unmap()
+{
+	if (--m_mapCount == 0) {
+		m_vkDevice.unmapMemory(m_vkMemory);
+		m_mapped = nullptr;
+	}
+}
+
+MemoryAllocator::MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device)
+	: m_vkDevice(device)
+	, m_vkMemoryProperties(physicalDevice.getMemoryProperties())
+	, m_nonCoherentAtomSize(physicalDevice.getProperties().limits.nonCoherentAtomSize)
+	, m_pools(VK_MAX_MEMORY_TYPES * 2)
+{
+}
+
+MemoryAllocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags flags, AllocationKind kind)
+{
+	auto memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, flags);
+	auto blockSize = getBlockSize(memoryTypeIndex);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto& pool = getPool(memoryTypeIndex, kind);
+
+	MemoryAllocation allocation;
+	allocation.size = requirements.size;
+
+	// Large resources get a block of their own instead of fragmenting the shared ones.
+	if (requirements.size > blockSize / 2) {
+		pool.blocks.emplace_back(std::make_unique<MemoryBlock>(m_vkDevice, requirements.size, memoryTypeIndex, true));
+		auto& block = pool.blocks.back();
+		block->allocate(requirements.size, 1, allocation.offset);
+		allocation.block = block.get();
+		allocation.memory = block->m_vkMemory;
+		return allocation;
+	}
+
+	for (auto& block : pool.blocks) {
+		if (!block->m_dedicated && block->allocate(requirements.size, requirements.alignment, allocation.offset)) {
+			allocation.block = block.get();
+			allocation.memory = block->m_vkMemory;
+			return allocation;
+		}
+	}
+
+	pool.blocks.emplace_back(std::make_unique<MemoryBlock>(m_vkDevice, blockSize, memoryTypeIndex, false));
+	auto& block = pool.blocks.back();
+	block->allocate(requirements.size, requirements.alignment, allocation.offset);
+	allocation.block = block.get();
+	allocation.memory = block->m_vkMemory;
+	return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation)
+{
+	if (!allocation) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto block = allocation.block;
+	block->free(allocation.offset, allocation.size);
+
+	if (block->isEmpty()) {
+		// The block must belong to one of the two pools of its memory type.
+		for (auto kind : { AllocationKind::eBuffer, AllocationKind::eImage }) {
+			auto& pool = getPool(block->m_memoryTypeIndex, kind);
+			if (std::any_of(ITERATE(pool.blocks), [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; })) {
+				releaseBlock(pool, block);
+				break;
+			}
+		}
+	}
+
+	allocation = MemoryAllocation();
+}
+
+void* MemoryAllocator::map(const MemoryAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<char*>(allocation.block->map()) + allocation.offset;
+}
+
+void MemoryAllocator::unmap(const MemoryAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	allocation.block->unmap();
+}
+
+bool MemoryAllocator::isCoherent(const MemoryAllocation& allocation) const
+{
+	auto flags = m_vkMemoryProperties.memoryTypes[allocation.block->m_memoryTypeIndex].propertyFlags;
+	return static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+void MemoryAllocator::flush(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const
+{
+	m_vkDevice.flushMappedMemoryRanges({ getMappedRange(allocation, offset, size) });
+}
+
+void MemoryAllocator::invalidate(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const
+{
+	m_vkDevice.invalidateMappedMemoryRanges({ getMappedRange(allocation, offset, size) });
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags flags) const
+{
+	for (uint32_t i = 0; i < m_vkMemoryProperties.memoryTypeCount; ++i) {
+		if (memoryTypeBits & (1 << i) &&
+			(m_vkMemoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+		{
+			return i;
+		}
+	}
+
+	PAPAGO_ERROR("Failed to find a memory type with the requested properties!");
+}
+
+size_t MemoryAllocator::getBlockCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t count = 0;
+	for (auto& pool : m_pools) {
+		count += pool.blocks.size();
+	}
+	return count;
+}
+
+std::vector<MemoryHeapStatistics> MemoryAllocator::getStatistics() const
+{
+	std::vector<MemoryHeapStatistics> heaps(m_vkMemoryProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < m_vkMemoryProperties.memoryHeapCount; ++i) {
+		heaps[i].size = m_vkMemoryProperties.memoryHeaps[i].size;
+		heaps[i].deviceLocal = static_cast<bool>(m_vkMemoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& pool : m_pools) {
+		for (auto& block : pool.blocks) {
+			auto& heap = heaps[m_vkMemoryProperties.memoryTypes[block->m_memoryTypeIndex].heapIndex];
+			heap.blockCount += 1;
+			heap.blockBytes += block->m_size;
+			heap.allocationCount += block->getAllocationCount();
+			heap.allocationBytes += block->getUsedSize();
+			// Dedicated blocks never take other allocations.
+			if (!block->m_dedicated) {
+				heap.largestFreeBlock = std::max<uint64_t>(heap.largestFreeBlock, block->getLargestFreeRange());
+			}
+		}
+	}
+
+	return heaps;
+}
+
+// Small heaps (e.g. the 256MB host visible device local heap) get smaller blocks, so a single block can't exhaust them.
+vk::DeviceSize MemoryAllocator::getBlockSize(uint32_t memoryTypeIndex) const
+{
+	auto heapIndex = m_vkMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	auto heapSize = m_vkMemoryProperties.memoryHeaps[heapIndex].size;
+	return std::min(DEFAULT_BLOCK_SIZE(), heapSize / 8);
+}
+
+// Mapped ranges must start and end on a multiple of nonCoherentAtomSize, or at the end of the memory object.
+vk::MappedMemoryRange MemoryAllocator::getMappedRange(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const
+{
+	auto begin = (allocation.offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+	auto end = (allocation.offset + offset + size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+
+	return vk::MappedMemoryRange()
+		.setMemory(allocation.memory)
+		.setOffset(begin)
+		.setSize(end >= allocation.block->m_size ? VK_WHOLE_SIZE : end - begin);
+}
+
+MemoryAllocator::Pool& MemoryAllocator::getPool(uint32_t memoryTypeIndex, AllocationKind kind)
+{
+	return m_pools[memoryTypeIndex * 2 + static_cast<uint32_t>(kind)];
+}
+
+// Empty blocks are returned to the driver, except for the last shared block of a pool which is kept around to avoid
+// allocating it again right away.
+void MemoryAllocator::releaseBlock(Pool& pool, MemoryBlock* block)
+{
+	if (!block->m_dedicated) {
+		auto sharedCount = std::count_if(ITERATE(pool.blocks), [](const std::unique_ptr<MemoryBlock>& b) { return !b->m_dedicated; });
+		if (sharedCount <= 1) {
+			return;
+		}
+	}
+
+	pool.blocks.erase(std::remove_if(ITERATE(pool.blocks), [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; }), pool.blocks.end());
+}
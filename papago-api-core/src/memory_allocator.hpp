@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include "idevice.hpp"
+
+class MemoryBlock;
+
+// Buffers and optimally tiled images are kept in separate pools, so bufferImageGranularity never has to be respected inside a block.
+enum class AllocationKind
+{
+	eBuffer = 0,
+	eImage	= 1
+};
+
+// A (block, offset) pair handed out by the MemoryAllocator. Owned by the Resource it was allocated for.
+struct MemoryAllocation
+{
+	MemoryBlock* block = nullptr;
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+
+	explicit operator bool() const { return block != nullptr; }
+};
+
+// One VkDeviceMemory allocation, carved into smaller ranges through a free-list.
+class MemoryBlock
+{
+public:
+	MemoryBlock(vk::Device device, vk::DeviceSize size, uint32_t memoryTypeIndex, bool dedicated);
+	MemoryBlock(const MemoryBlock&) = delete;
+	~MemoryBlock();
+
+	bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset);
+	void free(vk::DeviceSize offset, vk::DeviceSize size);
+	bool isEmpty() const;
+	vk::DeviceSize getUsedSize() const;
+	uint32_t getAllocationCount() const;
+	vk::DeviceSize getLargestFreeRange() const;
+
+	void* map();
+	void unmap();
+
+	vk::Device m_vkDevice;
+	vk::DeviceMemory m_vkMemory;
+	vk::DeviceSize m_size;
+	uint32_t m_memoryTypeIndex;
+	bool m_dedicated;
+
+private:
+	std::map<vk::DeviceSize, vk::DeviceSize> m_freeRanges;	//<-- offset -> size, neighbouring ranges are always merged.
+	vk::DeviceSize m_usedSize = 0;
+	uint32_t m_allocationCount = 0;
+	void* m_mapped = nullptr;
+	uint32_t m_mapCount = 0;
+};
+
+// Device-owned sub-allocator. Keeps a pool of large blocks per memory type, so the number of
+// VkDeviceMemory objects stays flat no matter how many resources are created.
+class MemoryAllocator
+{
+public:
+	// Only the handles are stored, as the Device owning the allocator is moved around after creation.
+	MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device);
+	MemoryAllocator(const MemoryAllocator&) = delete;
+
+	MemoryAllocation allocate(const vk::MemoryRequirements&, vk::MemoryPropertyFlags, AllocationKind);
+	void free(MemoryAllocation&);
+
+	void* map(const MemoryAllocation&);
+	void unmap(const MemoryAllocation&);
+
+	// Host writes to and reads from non-coherent memory must be made visible explicitly. Offsets are relative to the allocation.
+	bool isCoherent(const MemoryAllocation&) const;
+	void flush(const MemoryAllocation&, vk::DeviceSize offset, vk::DeviceSize size) const;
+	void invalidate(const MemoryAllocation&, vk::DeviceSize offset, vk::DeviceSize size) const;
+
+	uint32_t findMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags) const;
+	size_t getBlockCount() const;
+	// One entry per memory heap, counting only the memory allocated through this allocator.
+	std::vector<MemoryHeapStatistics> getStatistics() const;
+
+	static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE() { return 64ull * 1024 * 1024; }
+
+private:
+	struct Pool
+	{
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	};
+
+	vk::DeviceSize getBlockSize(uint32_t memoryTypeIndex) const;
+	Pool& getPool(uint32_t memoryTypeIndex, AllocationKind);
+	void releaseBlock(Pool&, MemoryBlock*);
+	vk::MappedMemoryRange getMappedRange(const MemoryAllocation&, vk::DeviceSize offset, vk::DeviceSize size) const;
+
+	vk::Device m_vkDevice;
+	vk::PhysicalDeviceMemoryProperties m_vkMemoryProperties;
+	vk::DeviceSize m_nonCoherentAtomSize;
+	std::vector<Pool> m_pools;	//<-- indexed by memory type * 2 + AllocationKind
+	mutable std::mutex m_mutex;
+};
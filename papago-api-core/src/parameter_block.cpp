@@ -4,6 +4,7 @@
 #include "buffer_resource.hpp"
 #include "image_resource.hpp"
 #include "sampler.hpp"
+#include <algorithm>
 
 ParameterBlock::ParameterBlock(const vk::UniqueDevice& device, RenderPass & renderPass, std::vector<ParameterBinding>& bindings)
 	: m_mask(0), m_renderPass(renderPass)
@@ -13,6 +14,7 @@ ParameterBlock::ParameterBlock(const vk::UniqueDevice& device, RenderPass & rend
 		if (binding.type == BindingType::eDynamicBufferResource) {
 			m_mask |= (0x01 << bit);
 			++m_dynamicBufferCount;
+			m_dynamicBindings.push_back(bit);
 			m_namedAlignments[binding.name] = dynamic_cast<DynamicBufferResource&>(*binding.dBufResource).m_alignment;
 		}
 		else {
@@ -20,13 +22,26 @@ ParameterBlock::ParameterBlock(const vk::UniqueDevice& device, RenderPass & rend
 		}
 	}
 
+	std::sort(ITERATE(m_dynamicBindings));
+
 	renderPass.createNewPipelineIfNone(m_mask);
+	m_vkPipelineLayout = *renderPass.getPipelineLayout(m_mask);
 
 	makeVkDescriptorSet(device, bindings);
 
 	bindResources(device, bindings);
 }
 
+DynamicSlot ParameterBlock::dynamicSlot(const std::string& uniformName)
+{
+	auto alignment = m_namedAlignments.find(uniformName);
+	if (alignment == m_namedAlignments.end() || alignment->second == 0) {
+		PAPAGO_ERROR("No dynamic buffer resource is bound to " + uniformName);
+	}
+
+	return DynamicSlot(this, m_renderPass.getBinding(uniformName), alignment->second);
+}
+
 void ParameterBlock::makeVkDescriptorSet(const vk::UniqueDevice& device, std::vector<ParameterBinding>& bindings)
 {
 	//Descriptor Set Layout
@@ -92,6 +107,7 @@ void ParameterBlock::bindResources(const vk::UniqueDevice & device, std::vector<
 				binding.name, 
 				dynamic_cast<BufferResource&>(*binding.bufResource))
 			);
+			m_resources.push_back(dynamic_cast<BufferResource*>(binding.bufResource));
 			break;
 		case BindingType::eDynamicBufferResource:
 			bufferInfos.emplace_back();
@@ -100,6 +116,7 @@ void ParameterBlock::bindResources(const vk::UniqueDevice & device, std::vector<
 				binding.name, 
 				dynamic_cast<DynamicBufferResource&>(*binding.dBufResource))
 			);
+			m_resources.push_back(dynamic_cast<BufferResource*>(dynamic_cast<DynamicBufferResource&>(*binding.dBufResource).m_buffer.get()));
 			break;
 		case BindingType::eCombinedImageSampler:
 			imageInfos.emplace_back();
@@ -109,6 +126,7 @@ void ParameterBlock::bindResources(const vk::UniqueDevice & device, std::vector<
 				dynamic_cast<ImageResource&>(*binding.imgResource), 
 				dynamic_cast<Sampler&>(*binding.sampler))
 			);
+			m_resources.push_back(dynamic_cast<ImageResource*>(binding.imgResource));
 			break;
 		default:
 			PAPAGO_ERROR("Unknown binding type " + std::to_string(static_cast<int>(binding.type)));
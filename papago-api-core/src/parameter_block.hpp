@@ -2,23 +2,30 @@
 #include "iparameter_block.hpp"
 #include <vector>
 #include <map>
-#include "vulkan\vulkan.hpp"
+#include "vulkan/vulkan.hpp"
 
 class RenderPass;
 class BufferResource;
 class DynamicBufferResource;
 class ImageResource;
 class Sampler;
+class Resource;
 
 class ParameterBlock : public IParameterBlock {
 public:
 	ParameterBlock(const vk::UniqueDevice& device, RenderPass& renderPass, std::vector<ParameterBinding>& bindings);
+
+	DynamicSlot dynamicSlot(const std::string& uniformName) override;
+
 	vk::UniqueDescriptorPool m_vkPool;
 	vk::UniqueDescriptorSet m_vkDescriptorSet;
 	uint64_t m_mask;
 	RenderPass& m_renderPass;
 	uint32_t m_dynamicBufferCount = 0;
 	std::map<std::string, uint32_t> m_namedAlignments;
+	std::vector<uint32_t> m_dynamicBindings;	//<-- ascending, the order of the dynamic offsets when binding the set
+	vk::PipelineLayout m_vkPipelineLayout;	//<-- owned by m_renderPass
+	std::vector<Resource*> m_resources;	//<-- in use by every submission binding the block
 
 private:
 	void makeVkDescriptorSet(const vk::UniqueDevice& device, std::vector<ParameterBinding>& bindings);
@@ -5,6 +5,8 @@
 #include <sstream>
 #include <regex>
 #include <map>
+#include <fstream>
+#include <cstdio>
 
 
 Parser::Parser(const std::string & compilePath): m_compilePath(compilePath)
@@ -40,6 +42,7 @@ std::unique_ptr<IFragmentShader> Parser::compileFragmentShader(const std::string
 
 std::vector<char> Parser::compile(const std::string& source, const std::string& shaderType) const
 {
+#ifdef _WIN32
 	auto arg = std::string(" --stdin -S ") + shaderType
 		+ std::string(" -V -o ") + std::string(".\\temp.spv");
 
@@ -135,6 +138,40 @@ std::vector<char> Parser::compile(const std::string& source, const std::string&
 	CloseHandle(file);
 	DeleteFile(".\\temp.spv");
 	return buffer;
+#else
+	// The path is single quoted for the shell, so it may contain spaces. Quotes in it end the quoting and are escaped.
+	auto quotedPath = std::string("'");
+	for (auto c : m_compilePath) {
+		quotedPath += c == '\'' ? std::string("'\\''") : std::string(1, c);
+	}
+	quotedPath += "'";
+
+	auto command = quotedPath + " --stdin -S " + shaderType + " -V -o ./temp.spv";
+
+	// The validator prints its errors to stdout, which is inherited, so they show up next to ours.
+	auto pipe = popen(command.c_str(), "w");
+	if (pipe == nullptr)
+		PAPAGO_ERROR("Could not start compilation process.");
+
+	fwrite(source.c_str(), 1, source.size(), pipe);
+
+	if (pclose(pipe) != EXIT_SUCCESS) {
+		std::remove("./temp.spv");
+		PAPAGO_ERROR("Validator could not validate input. (stage: " + shaderType + ")");
+	}
+
+	std::ifstream file("./temp.spv", std::ios::binary | std::ios::ate);
+	if (!file)
+		PAPAGO_ERROR("Could not open file.");
+
+	std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(buffer.data(), buffer.size());
+
+	file.close();
+	std::remove("./temp.spv");
+	return buffer;
+#endif
 }
 
 size_t string_type_to_size(std::string type) {
@@ -154,7 +191,7 @@ size_t string_type_to_size(std::string type) {
 
 vk::Format string_type_to_format(std::string type) {
 	static const std::map<std::string, vk::Format> map{
-		{ "float", vk::Format::eD32Sfloat },
+		{ "float", vk::Format::eR32Sfloat },
 		{ "vec2", vk::Format::eR32G32Sfloat },
 		{ "vec3", vk::Format::eR32G32B32Sfloat },
 		{ "vec4", vk::Format::eR32G32B32A32Sfloat },
@@ -172,27 +209,56 @@ vk::Format string_type_to_format(std::string type) {
 
 void Parser::setShaderInput(VertexShader & shader, const std::string & source)
 {
-	static const auto regex = std::regex(".*layout\\s*\\(location\\s*=\\s*(" REGEX_NUMBER ")\\s*\\)\\s+in\\s+(" REGEX_NAME ")\\s+(" REGEX_NAME ");");
+	// The comment after an input may name its vertex buffer binding, see Parser::compileVertexShader.
+	static const auto regex = std::regex(".*layout\\s*\\(location\\s*=\\s*(" REGEX_NUMBER ")\\s*\\)\\s+in\\s+(" REGEX_NAME ")\\s+(" REGEX_NAME ");"
+		"(?:[ \\t]*//[ \\t]*binding[ \\t]*=[ \\t]*(" REGEX_NUMBER ")[ \\t]*(,[ \\t]*instance)?)?");
 	
+	std::map<uint32_t, vk::VertexInputRate> inputRates;
 
 	std::sregex_iterator iterator(ITERATE(source), regex);
 	for (auto i = iterator; i != std::sregex_iterator(); ++i) {
 		auto match = *i;
 		auto location = std::stoi(match[1]);
-		auto format = string_type_to_format(match[2].str());
+		auto type = match[2].str();
 		auto name = match[3].str();
+		uint32_t binding = match[4].matched ? std::stoi(match[4].str()) : 0;
+		auto inputRate = match[5].matched ? vk::VertexInputRate::eInstance : vk::VertexInputRate::eVertex;
+
+		auto rate = inputRates.find(binding);
+		if (rate != inputRates.end() && rate->second != inputRate) {
+			PAPAGO_ERROR("The inputs of binding " + std::to_string(binding) + " disagree on whether it is per instance (input: " + name + ")");
+		}
+		inputRates[binding] = inputRate;
+
+		// A matrix takes a location per column.
+		auto locationCount = type == "mat4" ? 4 : 1;
+		auto format = type == "mat4" ? string_type_to_format("vec4") : string_type_to_format(type);
 
-		if (shader.m_input.size() <= location) {
-			shader.m_input.resize(location+1);
+		if (shader.m_input.size() < location + locationCount) {
+			shader.m_input.resize(location + locationCount);
+		}
+		for (auto j = 0; j < locationCount; ++j) {
+			shader.m_input[location + j] = { 0, format, binding };
 		}
-		shader.m_input[location] = { 0, format };
+	}
+
+	for (auto& rate : inputRates) {
+		if (shader.m_inputBindings.size() <= rate.first) {
+			shader.m_inputBindings.resize(rate.first + 1);
+		}
+		shader.m_inputBindings[rate.first].inputRate = rate.second;
 	}
 
 	// Calculate offsets. Can't do it in loop above, as allocation order could be mixed.
-	auto offset = 0u;
+	// Unused locations keep an undefined format and take no space.
 	for (auto& input : shader.m_input) {
-		input.offset = offset;
-		offset += input.getFormatSize();
+		if (input.format == vk::Format::eUndefined) {
+			continue;
+		}
+
+		auto& binding = shader.m_inputBindings[input.binding];
+		input.offset = binding.stride;
+		binding.stride += input.getFormatSize();
 	}
 
 }
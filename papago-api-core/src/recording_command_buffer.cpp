@@ -5,39 +5,411 @@
 #include "render_pass.hpp"
 #include "buffer_resource.hpp"
 #include "parameter_block.hpp"
+#include "submission_pool.hpp"
 
+#include <algorithm>
 
 template<class T>
-T & CommandRecorder<T>::setDynamicIndex(IParameterBlock& parameterBlock, const std::string & uniformName, size_t index)
+CommandRecorder<T>::CommandRecorder(const vk::UniqueDevice& device, const DeviceCapabilities& capabilities)
+	: m_vkDevice(device)
+	, m_timestampPeriod(capabilities.timestampPeriod)
 {
-	auto& internalParameterBlock = dynamic_cast<ParameterBlock&>(parameterBlock);
-	auto dynamicBufferMask = internalParameterBlock.m_mask;
-	auto bindingCount = m_renderPassPtr->m_shaderProgram.getUniqueUniformBindings().size();
+	auto pipelineStatistics = capabilities.pipelineStatistics;
+	if (m_timestampPeriod <= 0.0f && !pipelineStatistics) {
+		return;
+	}
 
-	uint64_t longOne = 0x01;
-	std::vector<uint32_t> dynamicBindings;
-	for (auto i = 0; i < 64; ++i) {
-		if (dynamicBufferMask & (longOne << i)) {
-			dynamicBindings.push_back(i);
+	m_queryFrames.resize(QUERY_FRAME_COUNT());
+	for (auto& frame : m_queryFrames) {
+		if (m_timestampPeriod > 0.0f) {
+			frame.vkTimestampPool = m_vkDevice->createQueryPoolUnique(vk::QueryPoolCreateInfo()
+				.setQueryType(vk::QueryType::eTimestamp)
+				.setQueryCount(MAX_TIMESTAMPS() * 2));
 		}
+
+		if (pipelineStatistics) {
+			frame.vkStatisticsPool = m_vkDevice->createQueryPoolUnique(vk::QueryPoolCreateInfo()
+				.setQueryType(vk::QueryType::ePipelineStatistics)
+				.setQueryCount(MAX_PIPELINE_STATISTICS())
+				.setPipelineStatistics(
+					vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices |
+					vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+					vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+					vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
+					vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+					vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations));
+		}
+	}
+}
+
+template<class T>
+void CommandRecorder<T>::createCommandFrames(uint32_t queueFamilyIndex, vk::CommandBufferLevel level)
+{
+	m_commandFrameQueueFamilyIndex = queueFamilyIndex;
+	m_commandFrameLevel = level;
+	m_commandFrames.clear();
+	m_commandFrameIndex = 0;
+	addCommandFrames(MIN_COMMAND_FRAME_COUNT());
+}
+
+template<class T>
+void CommandRecorder<T>::addCommandFrames(size_t count)
+{
+	// The command buffers are only reset along with their pool, so the pools don't need eResetCommandBuffer.
+	std::vector<CommandFrame> frames(count);
+	for (auto& frame : frames) {
+		frame.vkCommandPool = m_vkDevice->createCommandPoolUnique(vk::CommandPoolCreateInfo()
+			.setQueueFamilyIndex(m_commandFrameQueueFamilyIndex));
+
+		vk::CommandBufferAllocateInfo allocateInfo = {};
+		allocateInfo.setCommandBufferCount(1)
+			.setCommandPool(*frame.vkCommandPool)
+			.setLevel(m_commandFrameLevel);
+
+		frame.vkCommandBuffer = std::move(m_vkDevice->allocateCommandBuffersUnique(allocateInfo)[0]);
+	}
+
+	auto position = m_commandFrames.empty() ? m_commandFrames.end() : m_commandFrames.begin() + m_commandFrameIndex + 1;
+	m_commandFrames.insert(position, std::make_move_iterator(frames.begin()), std::make_move_iterator(frames.end()));
+
+	// The frames have moved, and with them the command buffer handles.
+	m_vkCommandBuffer = &*m_commandFrames[m_commandFrameIndex].vkCommandBuffer;
+}
+
+template<class T>
+void CommandRecorder<T>::beginCommandFrame()
+{
+	m_commandFrameIndex = (m_commandFrameIndex + 1) % m_commandFrames.size();
+	auto& frame = m_commandFrames[m_commandFrameIndex];
+	if (frame.submissionPool != nullptr) {
+		frame.submissionPool->wait(frame.submission);
 	}
+	frame.submissionPool = nullptr;
+	frame.submission = 0;
 
-	auto dynamicOffsets = std::vector<uint32_t>();
+	m_vkDevice->resetCommandPool(*frame.vkCommandPool, vk::CommandPoolResetFlags());
+	m_vkCommandBuffer = &*frame.vkCommandBuffer;
+}
+
+template<class T>
+void CommandRecorder<T>::removeDuplicateResources()
+{
+	std::sort(ITERATE(m_resourcesInUse));
+	m_resourcesInUse.erase(std::unique(ITERATE(m_resourcesInUse)), m_resourcesInUse.end());
+}
 
-	auto binding = m_renderPassPtr->getBinding(uniformName);
-	//TODO: check [name] is actually in the map before trying to access the alignment. -AM
-	m_bindingDynamicOffset[binding] = internalParameterBlock.m_namedAlignments[uniformName] * index;
+template<class T>
+void CommandRecorder<T>::bindPipeline(vk::Pipeline pipeline)
+{
+	if (pipeline == m_boundState.pipeline) {
+		++m_bindStatistics.skipped;
+		return;
+	}
 
-	std::sort(dynamicBindings.begin(), dynamicBindings.end());
+	m_vkCommandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+	m_boundState.pipeline = pipeline;
+	++m_bindStatistics.issued;
+}
 
-	for (auto b : dynamicBindings) {
-		dynamicOffsets.push_back(m_bindingDynamicOffset[b]);
+// Sets bound with another pipeline layout may have been disturbed by the pipeline binds since, so the layout must match too.
+template<class T>
+void CommandRecorder<T>::bindDescriptorSet(vk::PipelineLayout layout, vk::DescriptorSet descriptorSet, const std::vector<uint32_t>& dynamicOffsets)
+{
+	if (descriptorSet == m_boundState.descriptorSet 
+		&& layout == m_boundState.layout 
+		&& dynamicOffsets == m_boundState.dynamicOffsets) 
+	{
+		++m_bindStatistics.skipped;
+		return;
 	}
 
-	m_vkCommandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *m_renderPassPtr->m_vkPipelineLayouts[internalParameterBlock.m_mask], 0, { *internalParameterBlock.m_vkDescriptorSet }, dynamicOffsets);
+	m_vkCommandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, { descriptorSet }, dynamicOffsets);
+	m_boundState.layout = layout;
+	m_boundState.descriptorSet = descriptorSet;
+	m_boundState.dynamicOffsets = dynamicOffsets;
+	++m_bindStatistics.issued;
+}
+
+// Binds the buffers from binding 0 and up. The bindings after them keep their buffers.
+template<class T>
+void CommandRecorder<T>::bindVertexBuffers(const std::vector<vk::Buffer>& buffers, const std::vector<vk::DeviceSize>& offsets)
+{
+	if (m_boundState.vertexBuffers.size() >= buffers.size()
+		&& std::equal(ITERATE(buffers), m_boundState.vertexBuffers.begin())
+		&& std::equal(ITERATE(offsets), m_boundState.vertexOffsets.begin()))
+	{
+		++m_bindStatistics.skipped;
+		return;
+	}
+
+	m_vkCommandBuffer->bindVertexBuffers(0, buffers, offsets);
+	if (m_boundState.vertexBuffers.size() < buffers.size()) {
+		m_boundState.vertexBuffers.resize(buffers.size());
+		m_boundState.vertexOffsets.resize(buffers.size());
+	}
+	std::copy(ITERATE(buffers), m_boundState.vertexBuffers.begin());
+	std::copy(ITERATE(offsets), m_boundState.vertexOffsets.begin());
+	++m_bindStatistics.issued;
+}
+
+template<class T>
+void CommandRecorder<T>::bindIndexBuffer(vk::Buffer buffer, vk::IndexType indexType)
+{
+	if (buffer == m_boundState.indexBuffer && indexType == m_boundState.indexType) {
+		++m_bindStatistics.skipped;
+		return;
+	}
+
+	m_vkCommandBuffer->bindIndexBuffer(buffer, 0, indexType);
+	m_boundState.indexBuffer = buffer;
+	m_boundState.indexType = indexType;
+	++m_bindStatistics.issued;
+}
+
+template<class T>
+void CommandRecorder<T>::resetBoundState()
+{
+	m_boundState.pipeline = vk::Pipeline();
+	m_boundState.layout = vk::PipelineLayout();
+	m_boundState.descriptorSet = vk::DescriptorSet();
+	m_boundState.dynamicOffsets.clear();
+	m_boundState.vertexBuffers.clear();
+	m_boundState.vertexOffsets.clear();
+	m_boundState.indexBuffer = vk::Buffer();
+}
+
+template<class T>
+T & CommandRecorder<T>::setDynamicIndex(IParameterBlock& parameterBlock, const std::string & uniformName, size_t index)
+{
+	return setDynamicIndex(parameterBlock.dynamicSlot(uniformName), index);
+}
+
+// The offsets of the block's other dynamic bindings are the ones set last for them.
+template<class T>
+T & CommandRecorder<T>::setDynamicIndex(const DynamicSlot& slot, size_t index)
+{
+	if (slot.m_parameterBlock == nullptr) {
+		PAPAGO_ERROR("setDynamicIndex(...) called with a slot not resolved by a parameter block");
+	}
+
+	auto& internalParameterBlock = static_cast<ParameterBlock&>(*slot.m_parameterBlock);
+	m_bindingDynamicOffset[slot.m_binding] = slot.m_alignment * static_cast<uint32_t>(index);
+
+	m_dynamicOffsets.clear();
+	for (auto binding : internalParameterBlock.m_dynamicBindings) {
+		m_dynamicOffsets.push_back(m_bindingDynamicOffset[binding]);
+	}
+
+	bindDescriptorSet(internalParameterBlock.m_vkPipelineLayout, *internalParameterBlock.m_vkDescriptorSet, m_dynamicOffsets);
 	return *this;
 }
-;
 
+template<class T>
+T & CommandRecorder<T>::beginTimestamp(const std::string & name)
+{
+	if (m_queryFrames.empty() || !m_queryFrames[m_queryFrameIndex].vkTimestampPool) {
+		return *this;
+	}
+
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	if (frame.timestampNames.size() == MAX_TIMESTAMPS()) {
+		PAPAGO_ERROR("Too many timestamps in one recording!");
+	}
 
+	auto index = static_cast<uint32_t>(frame.timestampNames.size());
+	frame.timestampNames.push_back(name);
+	m_openTimestamps.push_back(index);
+	m_vkCommandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *frame.vkTimestampPool, index * 2);
+	return *this;
+}
 
+template<class T>
+T & CommandRecorder<T>::endTimestamp()
+{
+	if (m_queryFrames.empty() || !m_queryFrames[m_queryFrameIndex].vkTimestampPool) {
+		return *this;
+	}
+
+	if (m_openTimestamps.empty()) {
+		PAPAGO_ERROR("endTimestamp() called without a matching beginTimestamp(...)");
+	}
+
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	m_vkCommandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *frame.vkTimestampPool, m_openTimestamps.back() * 2 + 1);
+	m_openTimestamps.pop_back();
+	return *this;
+}
+
+template<class T>
+T & CommandRecorder<T>::beginPipelineStatistics(const std::string & name)
+{
+	if (m_queryFrames.empty() || !m_queryFrames[m_queryFrameIndex].vkStatisticsPool) {
+		PAPAGO_ERROR("Pipeline statistics require the pipelineStatisticsQuery feature!");
+	}
+
+	if (m_isCountingStatistics) {
+		PAPAGO_ERROR("beginPipelineStatistics(...) called while pipeline statistics are already being counted");
+	}
+
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	if (frame.statisticsNames.size() == MAX_PIPELINE_STATISTICS()) {
+		PAPAGO_ERROR("Too many pipeline statistics in one recording!");
+	}
+
+	auto index = static_cast<uint32_t>(frame.statisticsNames.size());
+	frame.statisticsNames.push_back(name);
+	m_isCountingStatistics = true;
+	m_vkCommandBuffer->beginQuery(*frame.vkStatisticsPool, index, vk::QueryControlFlags());
+	return *this;
+}
+
+template<class T>
+T & CommandRecorder<T>::endPipelineStatistics()
+{
+	if (!m_isCountingStatistics) {
+		PAPAGO_ERROR("endPipelineStatistics() called without a matching beginPipelineStatistics(...)");
+	}
+
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	m_vkCommandBuffer->endQuery(*frame.vkStatisticsPool, static_cast<uint32_t>(frame.statisticsNames.size() - 1));
+	m_isCountingStatistics = false;
+	return *this;
+}
+
+template<class T>
+void CommandRecorder<T>::markSubmitted(SubmissionPool& submissionPool, uint64_t submission, size_t framesInFlight)
+{
+	if (m_commandFrames.size() < framesInFlight + 1) {
+		addCommandFrames(framesInFlight + 1 - m_commandFrames.size());
+	}
+
+	auto& commandFrame = m_commandFrames[m_commandFrameIndex];
+	commandFrame.submissionPool = &submissionPool;
+	commandFrame.submission = submission;
+
+	if (m_queryFrames.empty()) {
+		return;
+	}
+
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	frame.submissionPool = &submissionPool;
+	frame.submission = submission;
+}
+
+template<class T>
+void CommandRecorder<T>::recordQueryReset(vk::CommandBuffer commandBuffer)
+{
+	if (m_queryFrames.empty()) {
+		return;
+	}
+
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	if (frame.vkTimestampPool) {
+		commandBuffer.resetQueryPool(*frame.vkTimestampPool, 0, MAX_TIMESTAMPS() * 2);
+	}
+	if (frame.vkStatisticsPool) {
+		commandBuffer.resetQueryPool(*frame.vkStatisticsPool, 0, MAX_PIPELINE_STATISTICS());
+	}
+}
+
+template<class T>
+void CommandRecorder<T>::beginQueries()
+{
+	if (m_queryFrames.empty()) {
+		return;
+	}
+
+	resolveQueries();
+
+	m_queryFrameIndex = (m_queryFrameIndex + 1) % m_queryFrames.size();
+	auto& frame = m_queryFrames[m_queryFrameIndex];
+	frame.timestampNames.clear();
+	frame.statisticsNames.clear();
+	frame.submissionPool = nullptr;
+	frame.submission = 0;
+	m_openTimestamps.clear();
+	m_isCountingStatistics = false;
+}
+
+template<class T>
+void CommandRecorder<T>::endQueries()
+{
+	if (!m_openTimestamps.empty()) {
+		PAPAGO_ERROR("A timestamp was begun but not ended before the recording ended!");
+	}
+
+	if (m_isCountingStatistics) {
+		PAPAGO_ERROR("Pipeline statistics were begun but not ended before the recording ended!");
+	}
+}
+
+// Submissions complete in order, so the newest complete frame is searched for from the current frame and back.
+template<class T>
+void CommandRecorder<T>::resolveQueries()
+{
+	for (size_t i = 0; i < m_queryFrames.size(); ++i) {
+		auto index = (m_queryFrameIndex + m_queryFrames.size() - i) % m_queryFrames.size();
+		auto& frame = m_queryFrames[index];
+		if (frame.submission <= m_resolvedSubmission 
+			|| (frame.timestampNames.empty() && frame.statisticsNames.empty()) 
+			|| !frame.submissionPool->isComplete(frame.submission)) 
+		{
+			continue;
+		}
+
+		if (!frame.timestampNames.empty()) {
+			auto queryCount = static_cast<uint32_t>(frame.timestampNames.size() * 2);
+			m_queryResults.resize(queryCount);
+			auto result = m_vkDevice->getQueryPoolResults<uint64_t>(
+				*frame.vkTimestampPool,
+				0,
+				queryCount,
+				m_queryResults,
+				sizeof(uint64_t),
+				vk::QueryResultFlagBits::e64);
+			if (result != vk::Result::eSuccess) {
+				continue;
+			}
+
+			m_timings.resize(frame.timestampNames.size());
+			for (size_t j = 0; j < frame.timestampNames.size(); ++j) {
+				auto ticks = m_queryResults[j * 2 + 1] - m_queryResults[j * 2];
+				m_timings[j].name = frame.timestampNames[j];
+				m_timings[j].milliseconds = ticks * static_cast<double>(m_timestampPeriod) / 1000000.0;
+			}
+		}
+
+		// One value per enabled statistic, in the order of their flag bits.
+		if (!frame.statisticsNames.empty()) {
+			const uint32_t valueCount = 6;
+			auto queryCount = static_cast<uint32_t>(frame.statisticsNames.size());
+			m_queryResults.resize(queryCount * valueCount);
+			auto result = m_vkDevice->getQueryPoolResults<uint64_t>(
+				*frame.vkStatisticsPool,
+				0,
+				queryCount,
+				m_queryResults,
+				sizeof(uint64_t) * valueCount,
+				vk::QueryResultFlagBits::e64);
+			if (result != vk::Result::eSuccess) {
+				continue;
+			}
+
+			m_pipelineStatistics.resize(queryCount);
+			for (size_t j = 0; j < queryCount; ++j) {
+				auto values = &m_queryResults[j * valueCount];
+				auto& statistics = m_pipelineStatistics[j];
+				statistics.name = frame.statisticsNames[j];
+				statistics.inputAssemblyVertices = values[0];
+				statistics.inputAssemblyPrimitives = values[1];
+				statistics.vertexShaderInvocations = values[2];
+				statistics.clippingInvocations = values[3];
+				statistics.clippingPrimitives = values[4];
+				statistics.fragmentShaderInvocations = values[5];
+			}
+		}
+
+		m_resolvedSubmission = frame.submission;
+		break;
+	}
+}
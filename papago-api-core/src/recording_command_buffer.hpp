@@ -1,7 +1,11 @@
 #pragma once
 
-#include <set>
+#include <vector>
+#include <array>
 #include <map>
+#include <string>
+#include "icommand_buffer.hpp"
+#include "device_capabilities.hpp"
 
 class IImageResource;
 class ISampler;
@@ -12,35 +16,126 @@ class IBufferResource;
 class DynamicBufferResource;
 class CommandBuffer;
 class IParameterBlock;
+class SubmissionPool;
 
 template<class T>
 class CommandRecorder
 	: public T
 {
 public:
-	CommandRecorder(const vk::UniqueDevice& device) : m_vkDevice(device) {};
+	// Creates the query pools of the timestamps and pipeline statistics the capabilities allow.
+	CommandRecorder(const vk::UniqueDevice& device, const DeviceCapabilities&);
 	CommandRecorder(CommandRecorder&& other)
 		: m_vkDevice(other.m_vkDevice)
-		, m_bindingDynamicOffset(std::move(other.m_bindingDynamicOffset))
+		, m_bindingDynamicOffset(other.m_bindingDynamicOffset)
 		, m_renderPassPtr(other.m_renderPassPtr)
 		, m_resourcesInUse(std::move(other.m_resourcesInUse))
-		, m_vkCommandBuffer(std::move(other.m_vkCommandBuffer))
-		, m_vkCommandPool(std::move(other.m_vkCommandPool))
+		, m_commandFrames(std::move(other.m_commandFrames))
+		, m_commandFrameIndex(other.m_commandFrameIndex)
+		, m_commandFrameQueueFamilyIndex(other.m_commandFrameQueueFamilyIndex)
+		, m_commandFrameLevel(other.m_commandFrameLevel)
+		, m_vkCommandBuffer(other.m_vkCommandBuffer)
+		, m_timestampPeriod(other.m_timestampPeriod)
+		, m_queryFrames(std::move(other.m_queryFrames))
+		, m_queryFrameIndex(other.m_queryFrameIndex)
+		, m_resolvedSubmission(other.m_resolvedSubmission)
+		, m_timings(std::move(other.m_timings))
+		, m_pipelineStatistics(std::move(other.m_pipelineStatistics))
+		, m_bindStatistics(other.m_bindStatistics)
 	{};
 
 	virtual ~CommandRecorder() = default;
 
 	// Inherited via IRecordingCommandBuffer
 	T& setDynamicIndex(IParameterBlock& parameterBlock, const std::string& uniformName, size_t) override;
+	T& setDynamicIndex(const DynamicSlot&, size_t) override;
+	T& beginTimestamp(const std::string& name) override;
+	T& endTimestamp() override;
+	T& beginPipelineStatistics(const std::string& name) override;
+	T& endPipelineStatistics() override;
 
-	std::map<uint32_t, uint32_t> m_bindingDynamicOffset;
-	std::set<Resource*> m_resourcesInUse;
+	// Marks the current recording, and the queries written by it, as executed by the submission. Called by the queue,
+	// which passes its frames in flight, so the command frames cover them.
+	void markSubmitted(SubmissionPool&, uint64_t submission, size_t framesInFlight);
+	// Records the reset of the queries written by the current recording. Must be recorded outside of a render pass,
+	// before the commands of the recording execute.
+	void recordQueryReset(vk::CommandBuffer);
+
+	std::array<uint32_t, 64> m_bindingDynamicOffset = {};	//<-- the latest offset set for each binding
+	// Resources used by the recorded commands, without duplicates once recording has ended. The queue marks them
+	// with the id of every submission of the command buffer.
+	std::vector<Resource*> m_resourcesInUse;
 protected:
+	// The command buffer of one recording, allocated from a pool of its own. Recordings use the frames in turn, and the
+	// pool of a frame is reset as a whole, keeping its memory, once the submissions of its previous recording are complete.
+	struct CommandFrame
+	{
+		vk::UniqueCommandPool vkCommandPool;
+		vk::UniqueCommandBuffer vkCommandBuffer;
+		SubmissionPool* submissionPool = nullptr;
+		uint64_t submission = 0;	//<-- the latest submission executing the recording, 0 if not submitted
+	};
+
+	// The queries of one recording. Recordings use the query pools in turn, so the results of a recording can be read
+	// once its submission is complete, while the following recordings are made and executed.
+	struct QueryFrame
+	{
+		vk::UniqueQueryPool vkTimestampPool;
+		std::vector<std::string> timestampNames;	//<-- one per begin/end pair, written to the queries 2 * i and 2 * i + 1
+		vk::UniqueQueryPool vkStatisticsPool;
+		std::vector<std::string> statisticsNames;	//<-- one per query
+		SubmissionPool* submissionPool = nullptr;
+		uint64_t submission = 0;	//<-- the latest submission executing the recording, 0 if not submitted
+	};
+
+	// What the command buffer being recorded has bound. Null handles are never bound, so they mark unknown state.
+	struct BoundState
+	{
+		vk::Pipeline pipeline;
+		vk::PipelineLayout layout;
+		vk::DescriptorSet descriptorSet;
+		std::vector<uint32_t> dynamicOffsets;
+		std::vector<vk::Buffer> vertexBuffers;	//<-- the index is the binding
+		std::vector<vk::DeviceSize> vertexOffsets;
+		vk::Buffer indexBuffer;
+		vk::IndexType indexType;
+	};
+
+	// Covers recording the next frame while one is queued. The first submission to a queue with more frames in flight
+	// adds command frames, so there is one per frame in flight plus the one being recorded, see markSubmitted.
+	static constexpr size_t MIN_COMMAND_FRAME_COUNT() { return 2; }
+	static constexpr size_t QUERY_FRAME_COUNT() { return 4; }
+	static constexpr uint32_t MAX_TIMESTAMPS() { return 64; }	//<-- begin/end pairs per recording
+	static constexpr uint32_t MAX_PIPELINE_STATISTICS() { return 16; }
+
+	void removeDuplicateResources();
+
+	// Record the bind, unless it would bind what is already bound.
+	void bindPipeline(vk::Pipeline);
+	void bindDescriptorSet(vk::PipelineLayout, vk::DescriptorSet, const std::vector<uint32_t>& dynamicOffsets);
+	void bindVertexBuffers(const std::vector<vk::Buffer>&, const std::vector<vk::DeviceSize>& offsets);
+	void bindIndexBuffer(vk::Buffer, vk::IndexType);
+	// Forgets the bound state, e.g. at the start of a recording or after executing sub command buffers.
+	void resetBoundState();
+	void createCommandFrames(uint32_t queueFamilyIndex, vk::CommandBufferLevel);
+	// Inserts unused command frames after the current one, which keeps the order the others are reused in.
+	void addCommandFrames(size_t count);
+	// Moves on to the next command frame, waiting for its previous recording to finish executing, and resets its pool.
+	void beginCommandFrame();
+	// Starts the queries of a new recording in the next query pools, resolving the pending results first.
+	void beginQueries();
+	void endQueries();
+	// Reads the results of the newest complete submission, if they are newer than the current results. Never waits.
+	void resolveQueries();
+
 	//TODO: Check that this is not null, when calling non-begin methods on the object. - Brandborg
 	// TODO: Another approach could be to create another interface and expose it via builder pattern or lambda expressions - CW 2018-04-23
 	RenderPass* m_renderPassPtr;
-	vk::UniqueCommandPool m_vkCommandPool;
-	vk::UniqueCommandBuffer m_vkCommandBuffer;
+	std::vector<CommandFrame> m_commandFrames;
+	size_t m_commandFrameIndex = 0;
+	uint32_t m_commandFrameQueueFamilyIndex = 0;
+	vk::CommandBufferLevel m_commandFrameLevel = vk::CommandBufferLevel::ePrimary;
+	vk::CommandBuffer* m_vkCommandBuffer = nullptr;	//<-- the command buffer of the current command frame
 	vk::RenderPassBeginInfo m_vkRenderPassBeginInfo;
 	vk::Extent2D m_vkCurrentRenderTargetExtent;
 
@@ -48,6 +143,20 @@ protected:
 
 	const vk::UniqueDevice& m_vkDevice;
 
+	float m_timestampPeriod;	//<-- nanoseconds per tick, 0 if the queue can't write timestamps
+	std::vector<QueryFrame> m_queryFrames;	//<-- empty if neither timestamps nor pipeline statistics are supported
+	size_t m_queryFrameIndex = 0;
+	std::vector<uint32_t> m_openTimestamps;
+	bool m_isCountingStatistics = false;
+	uint64_t m_resolvedSubmission = 0;
+	std::vector<GpuTiming> m_timings;
+	std::vector<PipelineStatistics> m_pipelineStatistics;
+	std::vector<uint64_t> m_queryResults;	//<-- scratch space for resolveQueries
+
+	BoundState m_boundState;
+	BindStatistics m_bindStatistics;	//<-- of the current recording
+	std::vector<uint32_t> m_dynamicOffsets;	//<-- scratch space for the descriptor set binds
+
 private:
 };
 
@@ -91,29 +91,35 @@ void RenderPass::setupDescriptorSetLayout(const vk::UniqueDevice &device, const
 	}
 }
 
-vk::VertexInputBindingDescription RenderPass::getBindingDescription()
+std::vector<vk::VertexInputBindingDescription> RenderPass::getBindingDescriptions()
 {
-	auto& inputs = m_shaderProgram.m_vertexShader.m_input;
-	auto& lastInput = inputs.back();
-	vk::VertexInputBindingDescription bindingDescription = {};
-	bindingDescription.binding = 0;
-	bindingDescription.stride = lastInput.offset + lastInput.getFormatSize();
-	bindingDescription.inputRate = vk::VertexInputRate::eVertex; //VK_VERTEX_INPUT_RATE_VERTEX
-
-	return bindingDescription;
+	auto& bindings = m_shaderProgram.m_vertexShader.m_inputBindings;
+	auto bindingDescriptions = std::vector<vk::VertexInputBindingDescription>();
+
+	for (uint32_t i = 0; i < bindings.size(); ++i) {
+		if (bindings[i].stride == 0) {
+			continue;
+		}
+
+		bindingDescriptions.emplace_back(i, bindings[i].stride, bindings[i].inputRate);
+	}
+
+	return bindingDescriptions;
 }
 
 std::vector<vk::VertexInputAttributeDescription> RenderPass::getAttributeDescriptions()
 {
 	auto inputCount = m_shaderProgram.m_vertexShader.m_input.size();
-	auto attributeDescriptions = std::vector<vk::VertexInputAttributeDescription>(inputCount);
+	auto attributeDescriptions = std::vector<vk::VertexInputAttributeDescription>();
 
-	for (auto i = 0; i < inputCount; ++i) {
+	for (uint32_t i = 0; i < inputCount; ++i) {
 		auto input = m_shaderProgram.m_vertexShader.m_input[i];
-		attributeDescriptions[i].setBinding(0)
-			.setLocation(i)
-			.setFormat(input.format)
-			.setOffset(input.offset);
+		// No input was declared at this location.
+		if (input.format == vk::Format::eUndefined) {
+			continue;
+		}
+
+		attributeDescriptions.emplace_back(i, input.binding, input.format, input.offset);
 	}
 
 	return attributeDescriptions;
@@ -170,15 +176,14 @@ void RenderPass::cacheNewPipeline(uint64_t bindingMask)
 	vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
 	//do the shader require a vertex buffer?
 	auto attributeDescription = getAttributeDescriptions();
-	vk::VertexInputBindingDescription bindingDescription;
+	auto bindingDescriptions = std::vector<vk::VertexInputBindingDescription>();
 
 	if (!m_shaderProgram.m_vertexShader.m_input.empty()) {
 
-		bindingDescription = getBindingDescription();
+		bindingDescriptions = getBindingDescriptions();
 
-		//TODO: how to handle vertex buffer existence and count? -AM
-		vertexInputInfo.setVertexBindingDescriptionCount(1)
-			.setPVertexBindingDescriptions(&bindingDescription)
+		vertexInputInfo.setVertexBindingDescriptionCount(bindingDescriptions.size())
+			.setPVertexBindingDescriptions(bindingDescriptions.data())
 			.setVertexAttributeDescriptionCount(attributeDescription.size())
 			.setPVertexAttributeDescriptions(attributeDescription.data());
 	}
@@ -1,7 +1,7 @@
 #pragma once
 #include <map>
 
-#include "vulkan\vulkan.hpp"
+#include "vulkan/vulkan.hpp"
 #include "api_enums.hpp"
 #include "shader_program.hpp"
 #include "irender_pass.hpp"
@@ -24,6 +24,7 @@ public:
 
 
 	vk::UniqueRenderPass m_vkRenderPass;
+	vk::UniqueRenderPass m_vkAttachmentOptimalRenderPass;	//<-- compatible with m_vkRenderPass, used by frame graphs
 
 	//The mask has 1 on binding index if the binding is a DynamicBuffer, 0 if it is a BufferResource.
 	std::map<uint64_t, vk::UniquePipeline> m_vkGraphicsPipelines;
@@ -36,7 +37,7 @@ public:
 
 	void setupDescriptorSetLayout(const vk::UniqueDevice&, const VertexShader& vertexShader, const FragmentShader& fragmentShader, uint64_t bindingMask);
 	long getBinding(const std::string& name) const;
-	vk::VertexInputBindingDescription getBindingDescription();
+	std::vector<vk::VertexInputBindingDescription> getBindingDescriptions();
 	std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions();
 
 	vk::UniquePipeline& getPipeline(uint64_t mask);
@@ -1,5 +1,8 @@
 #pragma once
 #include <vector>
+#include "memory_allocator.hpp"
+
+class SubmissionPool;
 
 class Resource
 {
@@ -7,26 +10,25 @@ public:
 	Resource(Resource&& other) noexcept;
 	Resource(const Resource&) = delete;
 
-	virtual ~Resource() = default;
+	virtual ~Resource();
 protected:
 	explicit Resource(const vk::UniqueDevice& device);
 
 	Resource(
-		const vk::PhysicalDevice& physicalDevice,
+		MemoryAllocator& allocator,
 		const vk::UniqueDevice& device,
 		vk::MemoryPropertyFlags flags,
-		vk::MemoryRequirements memoryRequirements);
+		vk::MemoryRequirements memoryRequirements,
+		AllocationKind kind);
 
-	vk::UniqueDeviceMemory m_vkMemory;
+	MemoryAllocation m_memory;
+	MemoryAllocator* m_allocator;
 	const vk::UniqueDevice& m_vkDevice;
-	static uint32_t findMemoryType(
-		const vk::PhysicalDevice&, 
-		uint32_t memoryTypeBits, 
-		const vk::MemoryPropertyFlags&);
 
 	//TODO: make m_size the actual size of the resource, not the alligned size. -AM
 	size_t m_size;
-	vk::Fence* m_vkFence;
+	SubmissionPool* m_submissionPool;	//<-- pool of the queue the resource was last submitted to
+	uint64_t m_lastSubmission;
 
 private:
 	friend class GraphicsQueue;
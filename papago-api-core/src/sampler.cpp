@@ -12,6 +12,7 @@ Sampler::Sampler(SamplerD dimension)
 	m_vkSamplerCreateInfo.maxAnisotropy = 16;
 	m_vkSamplerCreateInfo.borderColor = vk::BorderColor::eIntOpaqueBlack;
 	m_vkSamplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+	m_vkSamplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;	//<-- sample every mip level the image has
 }
 
 Sampler::operator vk::Sampler&()
@@ -27,7 +28,7 @@ Sampler& Sampler::setMagFilter(vk::Filter filter)
 
 Sampler& Sampler::setMinFilter(vk::Filter filter)
 {
-	m_vkSamplerCreateInfo.magFilter = filter;
+	m_vkSamplerCreateInfo.minFilter = filter;
 	return *this;
 }
 
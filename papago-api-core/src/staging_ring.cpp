@@ -0,0 +1,492 @@
+#include "standard_header.hpp"
+#include "staging_ring.hpp"
+
+StagingRing::StagingRing(
+	vk::Device device, 
+	MemoryAllocator& allocator, 
+	uint32_t queueFamilyIndex, 
+	vk::Queue queue, 
+	std::mutex& queueMutex,
+	vk::DeviceSize size, 
+	uint32_t handoffQueueFamilyIndex)
+	: m_vkDevice(device)
+	, m_allocator(allocator)
+	, m_vkQueue(queue)
+	, m_queueMutex(queueMutex)
+	, m_queueFamilyIndex(queueFamilyIndex)
+	, m_handoffQueueFamilyIndex(handoffQueueFamilyIndex)
+	, m_size(size)
+{
+	m_vkCommandPool = m_vkDevice.createCommandPoolUnique(vk::CommandPoolCreateInfo()
+		.setQueueFamilyIndex(queueFamilyIndex)
+		.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient));
+
+	m_vkBuffer = m_vkDevice.createBufferUnique(vk::BufferCreateInfo()
+		.setSize(size)
+		.setUsage(vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst));
+
+	auto memoryRequirements = m_vkDevice.getBufferMemoryRequirements(*m_vkBuffer);
+	m_memory = m_allocator.allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, AllocationKind::eBuffer);
+	m_vkDevice.bindBufferMemory(*m_vkBuffer, m_memory.memory, m_memory.offset);
+
+	m_mapped = static_cast<char*>(m_allocator.map(m_memory));
+}
+
+StagingRing::~StagingRing()
+{
+	if (m_recording) {
+		submitBatch();
+	}
+
+	for (auto& batch : m_inFlight) {
+		m_vkDevice.waitForFences({ *batch->fence }, VK_TRUE, UINT64_MAX);
+	}
+	retireBatches(false);
+
+	m_vkBuffer.reset();
+	m_allocator.unmap(m_memory);
+	m_allocator.free(m_memory);
+}
+
+void StagingRing::copyToBuffer(const void* data, vk::DeviceSize size, vk::Buffer dstBuffer, vk::DeviceSize dstOffset)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto source = static_cast<const char*>(data);
+	vk::DeviceSize copied = 0;
+	while (copied < size) {
+		auto chunkSize = std::min(size - copied, m_size);
+		auto ringOffset = reserve(chunkSize, 16);
+		memcpy(m_mapped + ringOffset, source + copied, chunkSize);
+
+		auto commandBuffer = getRecordingCommandBuffer();
+		synchronizeTransfer(commandBuffer, dstBuffer);
+		commandBuffer.copyBuffer(*m_vkBuffer, dstBuffer, { vk::BufferCopy(ringOffset, dstOffset + copied, chunkSize) });
+
+		m_recordingDestinations.emplace(dstBuffer);
+		copied += chunkSize;
+	}
+}
+
+void StagingRing::copyFromBuffer(vk::Buffer srcBuffer, vk::DeviceSize srcOffset, vk::DeviceSize size, void* data)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto destination = static_cast<char*>(data);
+	vk::DeviceSize copied = 0;
+	while (copied < size) {
+		auto chunkSize = std::min(size - copied, m_size);
+		auto ringOffset = reserve(chunkSize, 16);
+
+		auto commandBuffer = getRecordingCommandBuffer();
+		synchronizeTransfer(commandBuffer, srcBuffer);
+		commandBuffer.copyBuffer(srcBuffer, *m_vkBuffer, { vk::BufferCopy(srcOffset + copied, ringOffset, chunkSize) });
+		recordHostReadBarrier(commandBuffer);
+
+		waitForBatch(submitBatch());
+		memcpy(destination + copied, m_mapped + ringOffset, chunkSize);
+
+		copied += chunkSize;
+	}
+}
+
+uint64_t StagingRing::upload(const void* data, vk::DeviceSize size, const RecordFunction& recordFunc)
+{
+	return upload(data, size, recordFunc, {}, {});
+}
+
+uint64_t StagingRing::upload(
+	const void* data, 
+	vk::DeviceSize size, 
+	const RecordFunction& recordFunc, 
+	std::vector<vk::BufferMemoryBarrier> releaseBuffers, 
+	std::vector<vk::ImageMemoryBarrier> releaseImages)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (size > m_size) {
+		auto temporary = createTemporary(size);
+		memcpy(temporary.mapped, data, size);
+
+		auto commandBuffer = getRecordingCommandBuffer();
+		recordFunc(commandBuffer, *temporary.buffer, 0);
+		releaseOwnership(commandBuffer, releaseBuffers, releaseImages);
+		m_recording->temporaries.emplace_back(std::move(temporary));
+		return m_recording->id;
+	}
+
+	auto ringOffset = reserve(size, 16);
+	memcpy(m_mapped + ringOffset, data, size);
+
+	auto commandBuffer = getRecordingCommandBuffer();
+	recordFunc(commandBuffer, *m_vkBuffer, ringOffset);
+	releaseOwnership(commandBuffer, releaseBuffers, releaseImages);
+	return m_recording->id;
+}
+
+void StagingRing::readback(vk::DeviceSize size, const RecordFunction& recordFunc, void* data)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (size > m_size) {
+		auto temporary = createTemporary(size);
+
+		auto commandBuffer = getRecordingCommandBuffer();
+		recordFunc(commandBuffer, *temporary.buffer, 0);
+		recordHostReadBarrier(commandBuffer);
+
+		waitForBatch(submitBatch());
+		memcpy(data, temporary.mapped, size);
+		destroyTemporary(temporary);
+		return;
+	}
+
+	auto ringOffset = reserve(size, 16);
+
+	auto commandBuffer = getRecordingCommandBuffer();
+	recordFunc(commandBuffer, *m_vkBuffer, ringOffset);
+	recordHostReadBarrier(commandBuffer);
+
+	waitForBatch(submitBatch());
+	memcpy(data, m_mapped + ringOffset, size);
+}
+
+uint64_t StagingRing::record(const std::function<void(vk::CommandBuffer)>& recordFunc)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	recordFunc(getRecordingCommandBuffer());
+	return m_recording->id;
+}
+
+uint64_t StagingRing::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_recording) {
+		submitBatch();
+	}
+	retireBatches(false);
+
+	return m_nextBatchId - 1;
+}
+
+void StagingRing::wait(uint64_t batchId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	waitForBatch(batchId);
+}
+
+bool StagingRing::isComplete(uint64_t batchId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	retireBatches(false);
+	return batchId <= m_completedBatchId;
+}
+
+std::vector<StagingRing::Handoff> StagingRing::takeHandoffs()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto handoffs = std::move(m_handoffs);
+	m_handoffs.clear();
+	return handoffs;
+}
+
+void StagingRing::acquire(Handoff&& handoff)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto commandBuffer = getRecordingCommandBuffer();
+	if (!handoff.bufferBarriers.empty() || !handoff.imageBarriers.empty()) {
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eAllCommands,
+			vk::PipelineStageFlagBits::eAllCommands,
+			vk::DependencyFlags(),
+			{},
+			handoff.bufferBarriers,
+			handoff.imageBarriers);
+	}
+
+	m_recording->waitSemaphores.emplace_back(std::move(handoff.semaphore));
+}
+
+void StagingRing::waitFor(vk::Semaphore timelineSemaphore, uint64_t value)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	getRecordingCommandBuffer();
+	m_recording->timelineWaits.push_back(timelineSemaphore);
+	m_recording->timelineWaitValues.push_back(value);
+}
+
+// Returns the ring offset of size free bytes. If the ring is full, the oldest batches are waited upon until enough
+// space has been retired. A reservation never wraps, the remainder of the ring is skipped instead.
+vk::DeviceSize StagingRing::reserve(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	while (true) {
+		auto offset = m_head % m_size;
+		auto alignedOffset = (offset + alignment - 1) / alignment * alignment;
+		if (alignedOffset + size > m_size) {
+			alignedOffset = 0;
+		}
+
+		auto skipped = alignedOffset >= offset ? alignedOffset - offset : m_size - offset;
+		if (m_head + skipped + size - m_tail <= m_size) {
+			m_head += skipped + size;
+			return alignedOffset;
+		}
+
+		if (!m_inFlight.empty()) {
+			retireBatches(true);
+		}
+		else if (m_recording) {
+			submitBatch();
+		}
+		else {
+			m_tail = m_head;
+		}
+	}
+}
+
+vk::CommandBuffer StagingRing::getRecordingCommandBuffer()
+{
+	if (m_recording) {
+		return *m_recording->commandBuffer;
+	}
+
+	if (m_freeBatches.empty()) {
+		auto batch = std::make_unique<Batch>();
+		batch->commandBuffer = std::move(m_vkDevice.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo()
+			.setCommandPool(*m_vkCommandPool)
+			.setCommandBufferCount(1)
+			.setLevel(vk::CommandBufferLevel::ePrimary))[0]);
+		batch->fence = m_vkDevice.createFenceUnique({});
+		m_freeBatches.emplace_back(std::move(batch));
+	}
+
+	m_recording = std::move(m_freeBatches.back());
+	m_freeBatches.pop_back();
+	m_recording->id = m_nextBatchId++;
+
+	auto commandBuffer = *m_recording->commandBuffer;
+	commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	// Earlier submissions may still be reading the resources that are about to be overwritten.
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags(),
+		{},
+		{},
+		{});
+
+	return commandBuffer;
+}
+
+// Copies within a batch are unordered, so a buffer that has already been written by the batch needs a barrier
+// before it is touched again.
+void StagingRing::synchronizeTransfer(vk::CommandBuffer commandBuffer, vk::Buffer buffer)
+{
+	if (m_recordingDestinations.count(buffer) == 0) {
+		return;
+	}
+
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags(),
+		{ vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite) },
+		{},
+		{});
+	m_recordingDestinations.clear();
+}
+
+// The release half of a queue family ownership transfer; the acquire half is recorded on the handoff queue.
+// Between queues of the same family the barriers are plain barriers, and the batch's semaphore orders the queues.
+void StagingRing::releaseOwnership(vk::CommandBuffer commandBuffer, std::vector<vk::BufferMemoryBarrier>& buffers, std::vector<vk::ImageMemoryBarrier>& images)
+{
+	if (buffers.empty() && images.empty()) {
+		return;
+	}
+
+	auto transfersOwnership = m_handoffQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED && m_handoffQueueFamilyIndex != m_queueFamilyIndex;
+	auto srcQueueFamilyIndex = transfersOwnership ? m_queueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+	auto dstQueueFamilyIndex = transfersOwnership ? m_handoffQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+
+	for (auto& barrier : buffers) {
+		barrier.setSrcQueueFamilyIndex(srcQueueFamilyIndex).setDstQueueFamilyIndex(dstQueueFamilyIndex);
+	}
+	for (auto& barrier : images) {
+		barrier.setSrcQueueFamilyIndex(srcQueueFamilyIndex).setDstQueueFamilyIndex(dstQueueFamilyIndex);
+	}
+
+	if (!transfersOwnership) {
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {}, buffers, images);
+		return;
+	}
+
+	// The destination access of a release and the source access of an acquire are ignored, and the release queue
+	// may not even support the destination access.
+	auto releaseBuffers = buffers;
+	auto releaseImages = images;
+	for (auto& barrier : releaseBuffers) {
+		barrier.setDstAccessMask(vk::AccessFlags());
+	}
+	for (auto& barrier : releaseImages) {
+		barrier.setDstAccessMask(vk::AccessFlags());
+	}
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {}, releaseBuffers, releaseImages);
+
+	for (auto& barrier : buffers) {
+		m_recording->acquireBuffers.emplace_back(barrier.setSrcAccessMask(vk::AccessFlags()));
+	}
+	for (auto& barrier : images) {
+		m_recording->acquireImages.emplace_back(barrier.setSrcAccessMask(vk::AccessFlags()));
+	}
+}
+
+uint64_t StagingRing::submitBatch()
+{
+	auto commandBuffer = *m_recording->commandBuffer;
+
+	// Make the copies visible to everything submitted after this batch. A ring handing its uploads over to another
+	// queue runs on a queue that may only support transfers, the other queue acquires the uploads instead.
+	auto dstAccessFlags = m_handoffQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED
+		? vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead
+		: vk::AccessFlags(vk::AccessFlagBits::eTransferRead);
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(),
+		{ vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, dstAccessFlags) },
+		{},
+		{});
+	commandBuffer.end();
+
+	std::vector<vk::Semaphore> waitSemaphores;
+	for (auto& semaphore : m_recording->waitSemaphores) {
+		waitSemaphores.push_back(*semaphore);
+	}
+	// The values of the binary semaphores are ignored.
+	std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+	waitSemaphores.insert(waitSemaphores.end(), ITERATE(m_recording->timelineWaits));
+	waitValues.insert(waitValues.end(), ITERATE(m_recording->timelineWaitValues));
+	std::vector<vk::PipelineStageFlags> waitStages(waitSemaphores.size(), vk::PipelineStageFlagBits::eAllCommands);
+
+	vk::UniqueSemaphore signalSemaphore;
+	if (m_handoffQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED) {
+		signalSemaphore = m_vkDevice.createSemaphoreUnique({});
+	}
+
+	auto submitInfo = vk::SubmitInfo()
+		.setWaitSemaphoreCount(waitSemaphores.size())
+		.setPWaitSemaphores(waitSemaphores.data())
+		.setPWaitDstStageMask(waitStages.data())
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer);
+	if (signalSemaphore) {
+		submitInfo.setSignalSemaphoreCount(1)
+			.setPSignalSemaphores(&*signalSemaphore);
+	}
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo = {};
+	if (!m_recording->timelineWaits.empty()) {
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+		submitInfo.setPNext(&timelineSubmitInfo);
+	}
+	{
+		std::lock_guard<std::mutex> queueLock(m_queueMutex);
+		m_vkQueue.submit({ submitInfo }, *m_recording->fence);
+	}
+	m_recording->timelineWaits.clear();
+	m_recording->timelineWaitValues.clear();
+
+	if (signalSemaphore) {
+		Handoff handoff;
+		handoff.semaphore = std::move(signalSemaphore);
+		handoff.bufferBarriers = std::move(m_recording->acquireBuffers);
+		handoff.imageBarriers = std::move(m_recording->acquireImages);
+		m_handoffs.emplace_back(std::move(handoff));
+	}
+	m_recording->acquireBuffers.clear();
+	m_recording->acquireImages.clear();
+
+	m_recordingDestinations.clear();
+	m_recording->end = m_head;
+	auto id = m_recording->id;
+	m_inFlight.emplace_back(std::move(m_recording));
+
+	return id;
+}
+
+// Batches are retired in submission order, which lets the tail of the ring move forward.
+void StagingRing::retireBatches(bool waitForOldest)
+{
+	if (waitForOldest && !m_inFlight.empty()) {
+		m_vkDevice.waitForFences({ *m_inFlight.front()->fence }, VK_TRUE, UINT64_MAX);
+	}
+
+	while (!m_inFlight.empty() && m_vkDevice.getFenceStatus(*m_inFlight.front()->fence) == vk::Result::eSuccess) {
+		auto batch = std::move(m_inFlight.front());
+		m_inFlight.pop_front();
+
+		m_tail = batch->end;
+		m_completedBatchId = batch->id;
+
+		for (auto& temporary : batch->temporaries) {
+			destroyTemporary(temporary);
+		}
+		batch->temporaries.clear();
+		batch->waitSemaphores.clear();
+
+		m_vkDevice.resetFences({ *batch->fence });
+		m_freeBatches.emplace_back(std::move(batch));
+	}
+}
+
+void StagingRing::waitForBatch(uint64_t batchId)
+{
+	if (m_recording && batchId >= m_recording->id) {
+		submitBatch();
+	}
+
+	while (m_completedBatchId < batchId && !m_inFlight.empty()) {
+		retireBatches(true);
+	}
+}
+
+StagingRing::TemporaryBuffer StagingRing::createTemporary(vk::DeviceSize size)
+{
+	TemporaryBuffer temporary;
+	temporary.buffer = m_vkDevice.createBufferUnique(vk::BufferCreateInfo()
+		.setSize(size)
+		.setUsage(vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst));
+
+	auto memoryRequirements = m_vkDevice.getBufferMemoryRequirements(*temporary.buffer);
+	temporary.memory = m_allocator.allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, AllocationKind::eBuffer);
+	m_vkDevice.bindBufferMemory(*temporary.buffer, temporary.memory.memory, temporary.memory.offset);
+	temporary.mapped = static_cast<char*>(m_allocator.map(temporary.memory));
+
+	return temporary;
+}
+
+void StagingRing::destroyTemporary(TemporaryBuffer& temporary)
+{
+	temporary.buffer.reset();
+	m_allocator.unmap(temporary.memory);
+	m_allocator.free(temporary.memory);
+}
+
+void StagingRing::recordHostReadBarrier(vk::CommandBuffer commandBuffer)
+{
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eHost,
+		vk::DependencyFlags(),
+		{ vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead) },
+		{},
+		{});
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <set>
+#include <functional>
+#include "memory_allocator.hpp"
+
+// Persistently mapped upload (and readback) buffer used to fill device local resources.
+// Copies are recorded into batches, which are submitted in one go when the batch is flushed. A batch keeps
+// its part of the ring alive until its fence has been signaled.
+// A ring running on its own queue hands its batches over to another queue: every batch signals a semaphore, and the
+// resources released by the batch are acquired again on the other queue through StagingRing::acquire.
+class StagingRing
+{
+public:
+	// Uploaded resources on their way from one ring's queue to another's.
+	struct Handoff
+	{
+		vk::UniqueSemaphore semaphore;
+		std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+		std::vector<vk::ImageMemoryBarrier> imageBarriers;
+	};
+
+	// Only the handles are stored, as the Device owning the ring is moved around after creation. queueMutex is locked
+	// around submissions, see Device::getQueueMutex.
+	// handoffQueueFamilyIndex is the family of the queue consuming the uploads, if that isn't the queue of the ring.
+	StagingRing(
+		vk::Device device, 
+		MemoryAllocator& allocator, 
+		uint32_t queueFamilyIndex, 
+		vk::Queue queue, 
+		std::mutex& queueMutex,
+		vk::DeviceSize size = DEFAULT_SIZE(), 
+		uint32_t handoffQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+	StagingRing(const StagingRing&) = delete;
+	~StagingRing();
+
+	// Records a copy of data into dstBuffer. Uploads larger than the ring are split into several copies.
+	void copyToBuffer(const void* data, vk::DeviceSize size, vk::Buffer dstBuffer, vk::DeviceSize dstOffset);
+	// Copies the content of srcBuffer back to the host. Flushes and waits for the copy to finish.
+	void copyFromBuffer(vk::Buffer srcBuffer, vk::DeviceSize srcOffset, vk::DeviceSize size, void* data);
+
+	using RecordFunction = std::function<void(vk::CommandBuffer, vk::Buffer, vk::DeviceSize)>;
+
+	// Stages data and lets recordFunc record the commands reading it from (buffer, offset), e.g. a copy into an image.
+	// Returns the id of the batch the commands were recorded into.
+	uint64_t upload(const void* data, vk::DeviceSize size, const RecordFunction& recordFunc);
+	// As above, but releases the written resources to the handoff queue afterwards. The queue family indices of the
+	// barriers are filled in by the ring.
+	uint64_t upload(
+		const void* data, 
+		vk::DeviceSize size, 
+		const RecordFunction& recordFunc, 
+		std::vector<vk::BufferMemoryBarrier> releaseBuffers, 
+		std::vector<vk::ImageMemoryBarrier> releaseImages);
+	// Lets recordFunc record commands writing size bytes to (buffer, offset), then waits for this batch only and copies the result to data.
+	void readback(vk::DeviceSize size, const RecordFunction& recordFunc, void* data);
+	// Records commands that don't need staging memory, e.g. layout transitions, into the current batch.
+	uint64_t record(const std::function<void(vk::CommandBuffer)>& recordFunc);
+
+	// Submits the batch currently being recorded, if any, and returns the id of the latest submitted batch.
+	uint64_t flush();
+	void wait(uint64_t batchId);
+	bool isComplete(uint64_t batchId);
+
+	// Handoffs of the batches submitted since the last call, in submission order.
+	std::vector<Handoff> takeHandoffs();
+	// Makes the current batch wait for the handoff's semaphore and acquire the resources it released.
+	void acquire(Handoff&& handoff);
+	// Makes the current batch wait until the timeline semaphore reaches value.
+	void waitFor(vk::Semaphore timelineSemaphore, uint64_t value);
+
+	static constexpr vk::DeviceSize DEFAULT_SIZE() { return 16ull * 1024 * 1024; }
+
+private:
+	// Uploads that don't fit in the ring get a buffer of their own, released together with the batch.
+	struct TemporaryBuffer
+	{
+		vk::UniqueBuffer buffer;
+		MemoryAllocation memory;
+		char* mapped;
+	};
+
+	struct Batch
+	{
+		vk::UniqueCommandBuffer commandBuffer;
+		std::vector<TemporaryBuffer> temporaries;
+		vk::UniqueFence fence;
+		std::vector<vk::UniqueSemaphore> waitSemaphores;
+		std::vector<vk::Semaphore> timelineWaits;	//<-- owned by the queues whose submissions are waited for
+		std::vector<uint64_t> timelineWaitValues;
+		std::vector<vk::BufferMemoryBarrier> acquireBuffers;	//<-- handed over to the handoff queue on submission
+		std::vector<vk::ImageMemoryBarrier> acquireImages;
+		uint64_t id = 0;
+		uint64_t end = 0;	//<-- position of the ring head when the batch was submitted
+	};
+
+	vk::DeviceSize reserve(vk::DeviceSize size, vk::DeviceSize alignment);
+	vk::CommandBuffer getRecordingCommandBuffer();
+	void synchronizeTransfer(vk::CommandBuffer, vk::Buffer);
+	TemporaryBuffer createTemporary(vk::DeviceSize size);
+	void destroyTemporary(TemporaryBuffer&);
+	static void recordHostReadBarrier(vk::CommandBuffer);
+	void releaseOwnership(vk::CommandBuffer, std::vector<vk::BufferMemoryBarrier>&, std::vector<vk::ImageMemoryBarrier>&);
+	uint64_t submitBatch();
+	void retireBatches(bool waitForOldest);
+	void waitForBatch(uint64_t batchId);
+
+	vk::Device m_vkDevice;
+	MemoryAllocator& m_allocator;
+	vk::Queue m_vkQueue;
+	std::mutex& m_queueMutex;	//<-- shared with everything else submitting to m_vkQueue
+	uint32_t m_queueFamilyIndex;
+	uint32_t m_handoffQueueFamilyIndex;
+
+	vk::UniqueCommandPool m_vkCommandPool;
+	vk::UniqueBuffer m_vkBuffer;
+	MemoryAllocation m_memory;
+	char* m_mapped;
+	vk::DeviceSize m_size;
+
+	uint64_t m_head = 0;	//<-- monotonic write position, the ring offset is m_head % m_size
+	uint64_t m_tail = 0;	//<-- monotonic position of the oldest byte still in use by the GPU
+
+	std::unique_ptr<Batch> m_recording;
+	std::set<vk::Buffer> m_recordingDestinations;	//<-- buffers written by the batch being recorded
+	std::deque<std::unique_ptr<Batch>> m_inFlight;
+	std::vector<std::unique_ptr<Batch>> m_freeBatches;
+	uint64_t m_nextBatchId = 1;
+	uint64_t m_completedBatchId = 0;
+	std::vector<Handoff> m_handoffs;
+
+	std::mutex m_mutex;
+};
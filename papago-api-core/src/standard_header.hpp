@@ -3,12 +3,14 @@
 #include <sstream>
 
 // include before Vulkan to make sure that max and min macros aren't defined
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Windows.h>
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
 
 #include <iostream>
-#define VK_USE_PLATFORM_WIN32_KHR
 #include <vulkan/vulkan.hpp>
 #include "Logger.hpp"
 
@@ -60,6 +62,38 @@ inline vk::Format to_vulkan_format(Format format) {
 		return vk::Format::eR8G8B8A8Unorm;
 	case Format::eB8G8R8A8Unorm:
 		return vk::Format::eB8G8R8A8Unorm;
+	case Format::eBc1RgbUnormBlock:
+		return vk::Format::eBc1RgbUnormBlock;
+	case Format::eBc1RgbSrgbBlock:
+		return vk::Format::eBc1RgbSrgbBlock;
+	case Format::eBc1RgbaUnormBlock:
+		return vk::Format::eBc1RgbaUnormBlock;
+	case Format::eBc1RgbaSrgbBlock:
+		return vk::Format::eBc1RgbaSrgbBlock;
+	case Format::eBc2UnormBlock:
+		return vk::Format::eBc2UnormBlock;
+	case Format::eBc2SrgbBlock:
+		return vk::Format::eBc2SrgbBlock;
+	case Format::eBc3UnormBlock:
+		return vk::Format::eBc3UnormBlock;
+	case Format::eBc3SrgbBlock:
+		return vk::Format::eBc3SrgbBlock;
+	case Format::eBc4UnormBlock:
+		return vk::Format::eBc4UnormBlock;
+	case Format::eBc4SnormBlock:
+		return vk::Format::eBc4SnormBlock;
+	case Format::eBc5UnormBlock:
+		return vk::Format::eBc5UnormBlock;
+	case Format::eBc5SnormBlock:
+		return vk::Format::eBc5SnormBlock;
+	case Format::eBc6HUfloatBlock:
+		return vk::Format::eBc6HUfloatBlock;
+	case Format::eBc6HSfloatBlock:
+		return vk::Format::eBc6HSfloatBlock;
+	case Format::eBc7UnormBlock:
+		return vk::Format::eBc7UnormBlock;
+	case Format::eBc7SrgbBlock:
+		return vk::Format::eBc7SrgbBlock;
 	case Format::eS8Uint:
 		return vk::Format::eS8Uint;
 	case Format::eD32Sfloat:
@@ -82,6 +116,38 @@ inline Format from_vulkan_format(vk::Format format) {
 		return Format::eR8G8B8A8Unorm;
 	case vk::Format::eB8G8R8A8Unorm:
 		return Format::eB8G8R8A8Unorm;
+	case vk::Format::eBc1RgbUnormBlock:
+		return Format::eBc1RgbUnormBlock;
+	case vk::Format::eBc1RgbSrgbBlock:
+		return Format::eBc1RgbSrgbBlock;
+	case vk::Format::eBc1RgbaUnormBlock:
+		return Format::eBc1RgbaUnormBlock;
+	case vk::Format::eBc1RgbaSrgbBlock:
+		return Format::eBc1RgbaSrgbBlock;
+	case vk::Format::eBc2UnormBlock:
+		return Format::eBc2UnormBlock;
+	case vk::Format::eBc2SrgbBlock:
+		return Format::eBc2SrgbBlock;
+	case vk::Format::eBc3UnormBlock:
+		return Format::eBc3UnormBlock;
+	case vk::Format::eBc3SrgbBlock:
+		return Format::eBc3SrgbBlock;
+	case vk::Format::eBc4UnormBlock:
+		return Format::eBc4UnormBlock;
+	case vk::Format::eBc4SnormBlock:
+		return Format::eBc4SnormBlock;
+	case vk::Format::eBc5UnormBlock:
+		return Format::eBc5UnormBlock;
+	case vk::Format::eBc5SnormBlock:
+		return Format::eBc5SnormBlock;
+	case vk::Format::eBc6HUfloatBlock:
+		return Format::eBc6HUfloatBlock;
+	case vk::Format::eBc6HSfloatBlock:
+		return Format::eBc6HSfloatBlock;
+	case vk::Format::eBc7UnormBlock:
+		return Format::eBc7UnormBlock;
+	case vk::Format::eBc7SrgbBlock:
+		return Format::eBc7SrgbBlock;
 	case vk::Format::eD32Sfloat:
 		return Format::eD32Sfloat;
 	case vk::Format::eD32SfloatS8Uint:
@@ -558,6 +624,39 @@ inline size_t sizeOfFormat(vk::Format format)
 	return result;
 }
 
+// Size in bytes of a 4x4 block of a block compressed format, or 0 for formats that aren't block compressed.
+inline size_t blockSizeOfFormat(vk::Format format)
+{
+	switch (format)
+	{
+	case vk::Format::eBc1RgbUnormBlock:
+	case vk::Format::eBc1RgbSrgbBlock:
+	case vk::Format::eBc1RgbaUnormBlock:
+	case vk::Format::eBc1RgbaSrgbBlock:
+	case vk::Format::eBc4UnormBlock:
+	case vk::Format::eBc4SnormBlock:
+		return 8;
+	case vk::Format::eBc2UnormBlock:
+	case vk::Format::eBc2SrgbBlock:
+	case vk::Format::eBc3UnormBlock:
+	case vk::Format::eBc3SrgbBlock:
+	case vk::Format::eBc5UnormBlock:
+	case vk::Format::eBc5SnormBlock:
+	case vk::Format::eBc6HUfloatBlock:
+	case vk::Format::eBc6HSfloatBlock:
+	case vk::Format::eBc7UnormBlock:
+	case vk::Format::eBc7SrgbBlock:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+inline bool isBlockCompressed(vk::Format format)
+{
+	return blockSizeOfFormat(format) != 0;
+}
+
 inline DepthStencilFlags GetDepthStencilFlags(vk::Format format)
 {
 	DepthStencilFlags flags = DepthStencilFlags::eNone;
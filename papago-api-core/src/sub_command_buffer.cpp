@@ -5,21 +5,20 @@
 #include "recording_command_buffer.cpp" //<-- resolves linker issues. -AM
 #include "parameter_block.hpp"
 
-SubCommandBuffer::SubCommandBuffer(const vk::UniqueDevice& device, uint32_t queueFamilyIndex)
-	: CommandRecorder<IRecordingSubCommandBuffer>(device)
+SubCommandBuffer::SubCommandBuffer(const vk::UniqueDevice& device, uint32_t queueFamilyIndex, const DeviceCapabilities& capabilities)
+	: CommandRecorder<IRecordingSubCommandBuffer>(device, capabilities)
+	, m_hasMultiDrawIndirect(capabilities.multiDrawIndirect)
+	, m_maxDrawIndirectCount(capabilities.maxDrawIndirectCount)
+	, m_vkCmdDrawIndirectCount(nullptr)
+	, m_vkCmdDrawIndexedIndirectCount(nullptr)
 {
-	vk::CommandPoolCreateInfo poolCreateInfo = {};
-	poolCreateInfo.setQueueFamilyIndex(queueFamilyIndex)
-		.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+	createCommandFrames(queueFamilyIndex, vk::CommandBufferLevel::eSecondary);
 
-	m_vkCommandPool = device->createCommandPoolUnique(poolCreateInfo);
-
-	vk::CommandBufferAllocateInfo allocateInfo = {};
-	allocateInfo.setCommandBufferCount(1)	//TODO: find good way to make setable. -AM
-		.setCommandPool(*m_vkCommandPool)
-		.setLevel(vk::CommandBufferLevel::eSecondary);
-
-	m_vkCommandBuffer = std::move(device->allocateCommandBuffersUnique(allocateInfo)[0]);
+	// The entry points of an extension that isn't enabled may still be returned, but must not be called.
+	if (capabilities.drawIndirectCount) {
+		m_vkCmdDrawIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndirectCountKHR>(device->getProcAddr("vkCmdDrawIndirectCountKHR"));
+		m_vkCmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(device->getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+	}
 }
 
 SubCommandBuffer::operator vk::CommandBuffer&()
@@ -38,27 +37,67 @@ void SubCommandBuffer::begin()
 	beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 	beginInfo.pInheritanceInfo = &inheritInfo;
 
-	m_vkCommandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);	//TODO: have usage and reset (or not) accordingly. -AM
+	beginQueries();
+	beginCommandFrame();
 	m_vkCommandBuffer->begin(beginInfo);
+	m_resourcesInUse.clear();
+	resetBoundState();
+	m_bindStatistics = {};
 
 	if (m_renderPassPtr->m_shaderProgram.getUniqueUniformBindings().empty()) {
-		m_vkCommandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *m_renderPassPtr->getPipeline(0));
+		bindPipeline(*m_renderPassPtr->getPipeline(0));
 	}
 }
 
 
 void SubCommandBuffer::end()
 {
+	endQueries();
 	m_vkCommandBuffer->end();
+	removeDuplicateResources();
 }
 
 
 void SubCommandBuffer::record(IRenderPass &renderPass, std::function<void(IRecordingSubCommandBuffer&)> func)
 {
 	m_renderPassPtr = reinterpret_cast<RenderPass*>(&renderPass);
+	m_isRecorded = false;
 	begin();
 	func(*this);
 	end();
+	m_isRecorded = true;
+}
+
+bool SubCommandBuffer::recordOnce(IRenderPass &renderPass, std::function<void(IRecordingSubCommandBuffer&)> func)
+{
+	if (m_isRecorded && m_renderPassPtr == &static_cast<RenderPass&>(renderPass)) {
+		return false;
+	}
+
+	record(renderPass, func);
+	return true;
+}
+
+void SubCommandBuffer::invalidate()
+{
+	m_isRecorded = false;
+}
+
+std::vector<GpuTiming> SubCommandBuffer::getTimings()
+{
+	resolveQueries();
+	return m_timings;
+}
+
+std::vector<PipelineStatistics> SubCommandBuffer::getPipelineStatistics()
+{
+	resolveQueries();
+	return m_pipelineStatistics;
+}
+
+BindStatistics SubCommandBuffer::getBindStatistics() const
+{
+	return m_bindStatistics;
 }
 
 IRecordingSubCommandBuffer & SubCommandBuffer::drawIndexed(size_t indexCount, size_t instanceCount, size_t firstIndex, size_t vertexOffset, size_t firstInstance)
@@ -82,6 +121,135 @@ IRecordingSubCommandBuffer & SubCommandBuffer::draw(size_t vertexCount, size_t i
 	m_vkCommandBuffer->draw(vertexCount, instanceCount, firstVertex, firstInstance);
 }
 
+IRecordingSubCommandBuffer & SubCommandBuffer::drawIndirect(IBufferResource& commands, size_t drawCount, size_t offset)
+{
+	if (m_renderPassPtr == nullptr)
+	{
+		PAPAGO_ERROR("drawIndirect(...) called while not in a begin-context (begin(...) has not been called)");
+	}
+
+	if (m_hasMultiDrawIndirect && drawCount > m_maxDrawIndirectCount) {
+		PAPAGO_ERROR("drawIndirect(...) called with a drawCount above the device's maxDrawIndirectCount of " + std::to_string(m_maxDrawIndirectCount));
+	}
+
+	auto& internalCommands = static_cast<BufferResource&>(commands);
+	checkIndirectBuffer("drawIndirect", internalCommands, offset);
+	auto stride = static_cast<uint32_t>(sizeof(DrawIndirectCommand));
+
+	if (m_hasMultiDrawIndirect || drawCount <= 1) {
+		m_vkCommandBuffer->drawIndirect(*internalCommands.m_vkBuffer, offset, drawCount, stride);
+	}
+	else {
+		for (size_t i = 0; i < drawCount; ++i) {
+			m_vkCommandBuffer->drawIndirect(*internalCommands.m_vkBuffer, offset + i * stride, 1, stride);
+		}
+	}
+	m_resourcesInUse.push_back(&internalCommands);
+	return *this;
+}
+
+IRecordingSubCommandBuffer & SubCommandBuffer::drawIndexedIndirect(IBufferResource& commands, size_t drawCount, size_t offset)
+{
+	if (m_renderPassPtr == nullptr)
+	{
+		PAPAGO_ERROR("drawIndexedIndirect(...) called while not in a begin-context (begin(...) has not been called)");
+	}
+
+	if (m_hasMultiDrawIndirect && drawCount > m_maxDrawIndirectCount) {
+		PAPAGO_ERROR("drawIndexedIndirect(...) called with a drawCount above the device's maxDrawIndirectCount of " + std::to_string(m_maxDrawIndirectCount));
+	}
+
+	auto& internalCommands = static_cast<BufferResource&>(commands);
+	checkIndirectBuffer("drawIndexedIndirect", internalCommands, offset);
+	auto stride = static_cast<uint32_t>(sizeof(DrawIndexedIndirectCommand));
+
+	if (m_hasMultiDrawIndirect || drawCount <= 1) {
+		m_vkCommandBuffer->drawIndexedIndirect(*internalCommands.m_vkBuffer, offset, drawCount, stride);
+	}
+	else {
+		for (size_t i = 0; i < drawCount; ++i) {
+			m_vkCommandBuffer->drawIndexedIndirect(*internalCommands.m_vkBuffer, offset + i * stride, 1, stride);
+		}
+	}
+	m_resourcesInUse.push_back(&internalCommands);
+	return *this;
+}
+
+IRecordingSubCommandBuffer & SubCommandBuffer::drawIndirectCount(IBufferResource& commands, size_t offset, IBufferResource& countBuffer, size_t countOffset, size_t maxDrawCount)
+{
+	if (m_renderPassPtr == nullptr)
+	{
+		PAPAGO_ERROR("drawIndirectCount(...) called while not in a begin-context (begin(...) has not been called)");
+	}
+
+	if (m_vkCmdDrawIndirectCount == nullptr) {
+		PAPAGO_ERROR("drawIndirectCount(...) requires the drawIndirectCount extension!");
+	}
+
+	if (maxDrawCount > m_maxDrawIndirectCount) {
+		PAPAGO_ERROR("drawIndirectCount(...) called with a maxDrawCount above the device's maxDrawIndirectCount of " + std::to_string(m_maxDrawIndirectCount));
+	}
+
+	auto& internalCommands = static_cast<BufferResource&>(commands);
+	auto& internalCount = static_cast<BufferResource&>(countBuffer);
+	checkIndirectBuffer("drawIndirectCount", internalCommands, offset);
+	checkIndirectBuffer("drawIndirectCount", internalCount, countOffset);
+	m_vkCmdDrawIndirectCount(
+		*m_vkCommandBuffer,
+		*internalCommands.m_vkBuffer,
+		offset,
+		*internalCount.m_vkBuffer,
+		countOffset,
+		static_cast<uint32_t>(maxDrawCount),
+		sizeof(DrawIndirectCommand));
+	m_resourcesInUse.push_back(&internalCommands);
+	m_resourcesInUse.push_back(&internalCount);
+	return *this;
+}
+
+IRecordingSubCommandBuffer & SubCommandBuffer::drawIndexedIndirectCount(IBufferResource& commands, size_t offset, IBufferResource& countBuffer, size_t countOffset, size_t maxDrawCount)
+{
+	if (m_renderPassPtr == nullptr)
+	{
+		PAPAGO_ERROR("drawIndexedIndirectCount(...) called while not in a begin-context (begin(...) has not been called)");
+	}
+
+	if (m_vkCmdDrawIndexedIndirectCount == nullptr) {
+		PAPAGO_ERROR("drawIndexedIndirectCount(...) requires the drawIndirectCount extension!");
+	}
+
+	if (maxDrawCount > m_maxDrawIndirectCount) {
+		PAPAGO_ERROR("drawIndexedIndirectCount(...) called with a maxDrawCount above the device's maxDrawIndirectCount of " + std::to_string(m_maxDrawIndirectCount));
+	}
+
+	auto& internalCommands = static_cast<BufferResource&>(commands);
+	auto& internalCount = static_cast<BufferResource&>(countBuffer);
+	checkIndirectBuffer("drawIndexedIndirectCount", internalCommands, offset);
+	checkIndirectBuffer("drawIndexedIndirectCount", internalCount, countOffset);
+	m_vkCmdDrawIndexedIndirectCount(
+		*m_vkCommandBuffer,
+		*internalCommands.m_vkBuffer,
+		offset,
+		*internalCount.m_vkBuffer,
+		countOffset,
+		static_cast<uint32_t>(maxDrawCount),
+		sizeof(DrawIndexedIndirectCommand));
+	m_resourcesInUse.push_back(&internalCommands);
+	m_resourcesInUse.push_back(&internalCount);
+	return *this;
+}
+
+void SubCommandBuffer::checkIndirectBuffer(const std::string& function, const BufferResource& buffer, size_t offset) const
+{
+	if (!(buffer.m_vkUsage & vk::BufferUsageFlagBits::eIndirectBuffer)) {
+		PAPAGO_ERROR(function + "(...) called with a buffer that wasn't created as an indirect buffer");
+	}
+
+	if (offset % 4 != 0) {
+		PAPAGO_ERROR(function + "(...) called with an offset that isn't a multiple of 4");
+	}
+}
+
 IRecordingSubCommandBuffer & SubCommandBuffer::setVertexBuffer(IBufferResource &buffer)
 {
 	if (m_renderPassPtr == nullptr)
@@ -89,11 +257,36 @@ IRecordingSubCommandBuffer & SubCommandBuffer::setVertexBuffer(IBufferResource &
 		PAPAGO_ERROR("setInput(buffer) called while not in a begin-context (begin(...) has not been called)");
 	}
 
-	//TODO: find a more general way to fix offsets
-	m_vkCommandBuffer->bindVertexBuffers(
-		0,
-		{ *(static_cast<BufferResource&>(buffer)).m_vkBuffer },
-		{ 0 });
+	m_vkVertexBuffers.assign(1, *(static_cast<BufferResource&>(buffer)).m_vkBuffer);
+	m_vkVertexOffsets.assign(1, 0);
+	bindVertexBuffers(m_vkVertexBuffers, m_vkVertexOffsets);
+	m_resourcesInUse.push_back(&static_cast<BufferResource&>(buffer));
+	return *this;
+}
+
+IRecordingSubCommandBuffer & SubCommandBuffer::setVertexBuffers(const std::vector<std::reference_wrapper<IBufferResource>>& buffers, const std::vector<size_t>& offsets)
+{
+	if (m_renderPassPtr == nullptr)
+	{
+		PAPAGO_ERROR("setVertexBuffers(...) called while not in a begin-context (begin(...) has not been called)");
+	}
+
+	if (!offsets.empty() && offsets.size() != buffers.size()) {
+		PAPAGO_ERROR("setVertexBuffers(...) needs an offset for every buffer, or none at all");
+	}
+
+	m_vkVertexBuffers.clear();
+	m_vkVertexOffsets.clear();
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		auto& internalBuffer = static_cast<BufferResource&>(buffers[i].get());
+		m_vkVertexBuffers.push_back(*internalBuffer.m_vkBuffer);
+		m_vkVertexOffsets.push_back(offsets.empty() ? 0 : offsets[i]);
+		m_resourcesInUse.push_back(&internalBuffer);
+	}
+
+	if (!m_vkVertexBuffers.empty()) {
+		bindVertexBuffers(m_vkVertexBuffers, m_vkVertexOffsets);
+	}
 	return *this;
 }
 
@@ -107,10 +300,8 @@ IRecordingSubCommandBuffer & SubCommandBuffer::setIndexBuffer(IBufferResource &i
 	auto& internalIndexBuffer = static_cast<BufferResource&>(indexBuffer);
 	auto indexType = internalIndexBuffer.m_elementType == BufferResourceElementType::eUint32 ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
 
-	m_vkCommandBuffer->bindIndexBuffer(
-		*internalIndexBuffer.m_vkBuffer,
-		0,
-		indexType);
+	bindIndexBuffer(*internalIndexBuffer.m_vkBuffer, indexType);
+	m_resourcesInUse.push_back(&internalIndexBuffer);
 	return *this;
 }
 IRecordingSubCommandBuffer & SubCommandBuffer::setParameterBlock(IParameterBlock& parameterBlock)
@@ -119,14 +310,10 @@ IRecordingSubCommandBuffer & SubCommandBuffer::setParameterBlock(IParameterBlock
 	auto& pipeline = m_renderPassPtr->getPipeline(internalParameterBlock.m_mask);
 	auto& layout = m_renderPassPtr->getPipelineLayout(internalParameterBlock.m_mask);
 
-	m_vkCommandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline);
-	m_vkCommandBuffer->bindDescriptorSets(
-		vk::PipelineBindPoint::eGraphics, 
-		*layout, 
-		0, 
-		{ *internalParameterBlock.m_vkDescriptorSet }, 
-		std::vector<uint32_t>(internalParameterBlock.m_dynamicBufferCount)
-	);
+	bindPipeline(*pipeline);
+	m_dynamicOffsets.assign(internalParameterBlock.m_dynamicBufferCount, 0);
+	bindDescriptorSet(*layout, *internalParameterBlock.m_vkDescriptorSet, m_dynamicOffsets);
+	m_resourcesInUse.insert(m_resourcesInUse.end(), ITERATE(internalParameterBlock.m_resources));
 	
 	return *this;
 }
@@ -16,16 +16,26 @@ class CommandBuffer;
 class SubCommandBuffer : public ISubCommandBuffer, public CommandRecorder<IRecordingSubCommandBuffer>
 {
 public:
-	SubCommandBuffer(const vk::UniqueDevice&, uint32_t queueFamilyIndex);
+	SubCommandBuffer(const vk::UniqueDevice&, uint32_t queueFamilyIndex, const DeviceCapabilities& = DeviceCapabilities());
 
 	explicit operator vk::CommandBuffer&();
 	
 	// Inherited via ISubCommandBuffer
 	void record(IRenderPass &, std::function<void(IRecordingSubCommandBuffer&)>) override;
+	bool recordOnce(IRenderPass &, std::function<void(IRecordingSubCommandBuffer&)>) override;
+	void invalidate() override;
+	std::vector<GpuTiming> getTimings() override;
+	std::vector<PipelineStatistics> getPipelineStatistics() override;
+	BindStatistics getBindStatistics() const override;
 
 	IRecordingSubCommandBuffer& drawIndexed(size_t indexCount, size_t instanceCount = 1, size_t firstIndex = 0, size_t vertexOffset = 0, size_t firstInstance = 0) override;
 	IRecordingSubCommandBuffer& draw(size_t vertexCount, size_t instanceCount = 1, size_t firstVertex = 0, size_t firstInstance = 0) override;
+	IRecordingSubCommandBuffer& drawIndirect(IBufferResource& commands, size_t drawCount, size_t offset = 0) override;
+	IRecordingSubCommandBuffer& drawIndexedIndirect(IBufferResource& commands, size_t drawCount, size_t offset = 0) override;
+	IRecordingSubCommandBuffer& drawIndirectCount(IBufferResource& commands, size_t offset, IBufferResource& countBuffer, size_t countOffset, size_t maxDrawCount) override;
+	IRecordingSubCommandBuffer& drawIndexedIndirectCount(IBufferResource& commands, size_t offset, IBufferResource& countBuffer, size_t countOffset, size_t maxDrawCount) override;
 	IRecordingSubCommandBuffer& setVertexBuffer(IBufferResource &) override;
+	IRecordingSubCommandBuffer& setVertexBuffers(const std::vector<std::reference_wrapper<IBufferResource>>&, const std::vector<size_t>& offsets = {}) override;
 	IRecordingSubCommandBuffer& setIndexBuffer(IBufferResource &) override;
 	IRecordingSubCommandBuffer& setParameterBlock(IParameterBlock&) override;
 
@@ -33,4 +43,15 @@ private:
 
 	void begin();
 	void end();
+	// Checks the buffer and offset of an indirect draw or draw count against the rules of the Vulkan spec.
+	void checkIndirectBuffer(const std::string& function, const BufferResource&, size_t offset) const;
+
+	bool m_isRecorded = false;	//<-- the command buffer holds a complete recording for m_renderPassPtr
+	bool m_hasMultiDrawIndirect;
+	uint32_t m_maxDrawIndirectCount;	//<-- VkPhysicalDeviceLimits::maxDrawIndirectCount
+	PFN_vkCmdDrawIndirectCountKHR m_vkCmdDrawIndirectCount;	//<-- null if VK_KHR_draw_indirect_count isn't enabled
+	PFN_vkCmdDrawIndexedIndirectCountKHR m_vkCmdDrawIndexedIndirectCount;
+
+	std::vector<vk::Buffer> m_vkVertexBuffers;	//<-- scratch space for the vertex buffer binds
+	std::vector<vk::DeviceSize> m_vkVertexOffsets;
 };
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "standard_header.hpp"
+#include "submission_pool.hpp"
+
+SubmissionPool::SubmissionPool(vk::Device device, bool useTimelineSemaphore)
+	: m_vkDevice(device)
+	, m_useTimelineSemaphore(false)
+{
+	if (useTimelineSemaphore) {
+		m_vkGetSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(m_vkDevice.getProcAddr("vkGetSemaphoreCounterValueKHR"));
+		m_vkWaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(m_vkDevice.getProcAddr("vkWaitSemaphoresKHR"));
+	}
+
+	if (m_vkGetSemaphoreCounterValue != nullptr && m_vkWaitSemaphores != nullptr) {
+		VkSemaphoreTypeCreateInfoKHR typeCreateInfo = {};
+		typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		typeCreateInfo.initialValue = 0;
+
+		m_vkTimelineSemaphore = m_vkDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo().setPNext(&typeCreateInfo));
+		m_useTimelineSemaphore = true;
+	}
+}
+
+SubmissionPool::~SubmissionPool()
+{
+	wait(getLastSubmittedId());
+}
+
+uint64_t SubmissionPool::submit(vk::Queue queue, const vk::SubmitInfo& submitInfo, const uint64_t* waitValues)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto id = m_nextId++;
+
+	if (m_useTimelineSemaphore) {
+		// The timeline semaphore is signaled after the semaphores of the caller, whose values are ignored as they are binary.
+		m_signalSemaphores.assign(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+		m_signalSemaphores.push_back(*m_vkTimelineSemaphore);
+		m_signalValues.assign(m_signalSemaphores.size(), 0);
+		m_signalValues.back() = id;
+		if (waitValues != nullptr) {
+			m_waitValues.assign(waitValues, waitValues + submitInfo.waitSemaphoreCount);
+		}
+		else {
+			m_waitValues.assign(submitInfo.waitSemaphoreCount, 0);
+		}
+
+		VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo = {};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(m_signalValues.size());
+		timelineSubmitInfo.pSignalSemaphoreValues = m_signalValues.data();
+		timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(m_waitValues.size());
+		timelineSubmitInfo.pWaitSemaphoreValues = m_waitValues.data();
+
+		auto timelineSubmit = submitInfo;
+		timelineSubmit.setPNext(&timelineSubmitInfo)
+			.setSignalSemaphoreCount(static_cast<uint32_t>(m_signalSemaphores.size()))
+			.setPSignalSemaphores(m_signalSemaphores.data());
+
+		queue.submit({ timelineSubmit }, vk::Fence());
+		return id;
+	}
+
+	PendingSubmission pending;
+	pending.id = id;
+	pending.fence = takeFence();
+
+	queue.submit({ submitInfo }, *pending.fence);
+	m_pending.push_back(std::move(pending));
+	return id;
+}
+
+bool SubmissionPool::isComplete(uint64_t submissionId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (submissionId <= m_completedId) {
+		return true;
+	}
+	updateCompletedId();
+	return submissionId <= m_completedId;
+}
+
+// A fence may be recycled as soon as it is retired, so the pool stays locked while waiting for one. Waits on the
+// timeline semaphore don't touch the pool and happen unlocked.
+bool SubmissionPool::wait(uint64_t submissionId, uint64_t timeoutNanoseconds)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (submissionId <= m_completedId) {
+		return true;
+	}
+
+	if (m_useTimelineSemaphore) {
+		lock.unlock();
+
+		VkSemaphore semaphore = *m_vkTimelineSemaphore;
+
+		VkSemaphoreWaitInfoKHR waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &semaphore;
+		waitInfo.pValues = &submissionId;
+
+		if (m_vkWaitSemaphores(m_vkDevice, &waitInfo, timeoutNanoseconds) != VK_SUCCESS) {
+			return false;
+		}
+
+		lock.lock();
+		m_completedId = std::max(m_completedId, submissionId);
+		return true;
+	}
+
+	// Ids are consecutive, so the fence of the submission is found by its distance to the oldest pending one.
+	if (m_pending.empty() || submissionId > m_pending.back().id) {
+		PAPAGO_ERROR("Waiting for a submission that hasn't been made");
+	}
+
+	auto& fence = *m_pending[submissionId - m_pending.front().id].fence;
+	if (m_vkDevice.waitForFences({ fence }, VK_TRUE, timeoutNanoseconds) != vk::Result::eSuccess) {
+		return false;
+	}
+
+	retireSubmissions();
+	return true;
+}
+
+uint64_t SubmissionPool::getLastSubmittedId() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_nextId - 1;
+}
+
+uint64_t SubmissionPool::getCompletedId()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	updateCompletedId();
+	return m_completedId;
+}
+
+void SubmissionPool::updateCompletedId()
+{
+	if (m_useTimelineSemaphore) {
+		uint64_t value = 0;
+		m_vkGetSemaphoreCounterValue(m_vkDevice, *m_vkTimelineSemaphore, &value);
+		m_completedId = std::max(m_completedId, value);
+		return;
+	}
+
+	retireSubmissions();
+}
+
+vk::Semaphore SubmissionPool::getTimelineSemaphore() const
+{
+	return m_useTimelineSemaphore ? *m_vkTimelineSemaphore : vk::Semaphore();
+}
+
+// Submissions on a queue finish in order, so only the oldest fence has to be checked. Each retired fence is reset
+// and goes back to the free list.
+void SubmissionPool::retireSubmissions()
+{
+	while (!m_pending.empty() && m_vkDevice.getFenceStatus(*m_pending.front().fence) == vk::Result::eSuccess) {
+		auto& pending = m_pending.front();
+		m_completedId = pending.id;
+
+		m_vkDevice.resetFences({ *pending.fence });
+		m_freeFences.push_back(std::move(pending.fence));
+		m_pending.pop_front();
+	}
+}
+
+vk::UniqueFence SubmissionPool::takeFence()
+{
+	if (m_freeFences.empty()) {
+		return m_vkDevice.createFenceUnique({});
+	}
+
+	auto fence = std::move(m_freeFences.back());
+	m_freeFences.pop_back();
+	return fence;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <mutex>
+
+// Numbers the submissions made to a queue and tracks which of them the GPU has finished.
+// With timeline semaphores a single semaphore counts the finished submissions. Otherwise every pending submission
+// holds a fence, and fences are retired in submission order and recycled through a free list.
+// Command buffers recorded on other threads check their earlier submissions, so every member function locks the pool.
+class SubmissionPool
+{
+public:
+	// Only the handle is stored, as the Device owning the queue is moved around after creation.
+	SubmissionPool(vk::Device device, bool useTimelineSemaphore);
+	SubmissionPool(const SubmissionPool&) = delete;
+	~SubmissionPool();
+
+	// Submits submitInfo to queue along with what is needed to track it. Returns the id of the submission,
+	// which is one higher than the id of the previous submission.
+	// waitValues holds a value per wait semaphore of submitInfo, which is only used for timeline semaphores.
+	uint64_t submit(vk::Queue queue, const vk::SubmitInfo& submitInfo, const uint64_t* waitValues = nullptr);
+	// Only asks the driver if the submission wasn't already known to be complete.
+	bool isComplete(uint64_t submissionId);
+	// Returns false if the submission didn't complete within the timeout.
+	bool wait(uint64_t submissionId, uint64_t timeoutNanoseconds = UINT64_MAX);
+
+	uint64_t getLastSubmittedId() const;
+	// Id of the latest submission known to be finished, every earlier submission is finished too.
+	uint64_t getCompletedId();
+	// The semaphore reaching the id of each finished submission, or a null handle if fences are used.
+	vk::Semaphore getTimelineSemaphore() const;
+
+private:
+	struct PendingSubmission
+	{
+		uint64_t id;
+		vk::UniqueFence fence;
+	};
+
+	// Both expect m_mutex to be locked.
+	void updateCompletedId();
+	void retireSubmissions();
+	vk::UniqueFence takeFence();
+
+	vk::Device m_vkDevice;
+	bool m_useTimelineSemaphore;
+
+	vk::UniqueSemaphore m_vkTimelineSemaphore;	//<-- its value is the id of the latest finished submission
+	PFN_vkGetSemaphoreCounterValueKHR m_vkGetSemaphoreCounterValue = nullptr;
+	PFN_vkWaitSemaphoresKHR m_vkWaitSemaphores = nullptr;
+
+	std::deque<PendingSubmission> m_pending;
+	std::vector<vk::UniqueFence> m_freeFences;
+	std::vector<vk::Semaphore> m_signalSemaphores;	//<-- scratch space for timeline submissions
+	std::vector<uint64_t> m_signalValues;
+	std::vector<uint64_t> m_waitValues;
+
+	uint64_t m_nextId = 1;
+	uint64_t m_completedId = 0;
+
+	mutable std::mutex m_mutex;
+};
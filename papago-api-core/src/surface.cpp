@@ -2,6 +2,7 @@
 #include "surface.hpp"
 
 #include <sstream>
+#include <cstring>
 
 Surface::operator vk::SurfaceKHR&()
 {
@@ -90,6 +91,16 @@ void Surface::checkInstanceLayers(const std::vector<const char*>& requiredLayers
 	}
 }
 
+bool Surface::isInstanceExtensionSupported(const char* extensionName)
+{
+	auto extensions = vk::enumerateInstanceExtensionProperties();
+	return std::any_of(ITERATE(extensions), [extensionName](const vk::ExtensionProperties& extension)
+	{
+		return strcmp(extensionName, extension.extensionName) == 0;
+	});
+}
+
+#ifdef _WIN32
 std::unique_ptr<ISurface> ISurface::createWin32Surface(size_t width, size_t height, HWND window)
 {
 	return std::make_unique<Surface>(width, height, window);
@@ -97,17 +108,49 @@ std::unique_ptr<ISurface> ISurface::createWin32Surface(size_t width, size_t heig
 
 Surface::Surface(uint32_t width, uint32_t height, HWND hwnd) : ISurface(width, height)
 {
-	vk::ApplicationInfo appInfo("PapaGo-api", VK_MAKE_VERSION(1, 0, 0), "No Engine", VK_MAKE_VERSION(1, 0, 0), VK_API_VERSION_1_0);
-
-	std::vector<const char*> surfaceExtensions = {
+	createInstance({
 		VK_KHR_SURFACE_EXTENSION_NAME,
 		VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
-	};
+	});
+
+	auto surfaceCreateInfo = vk::Win32SurfaceCreateInfoKHR()
+		.setHwnd(hwnd)
+		.setHinstance(GetModuleHandle(nullptr));
+
+	m_vkSurfaceKHR = m_vkInstance->createWin32SurfaceKHRUnique(surfaceCreateInfo);
+}
+#endif
+
+std::unique_ptr<ISurface> ISurface::createHeadlessSurface(size_t width, size_t height)
+{
+	return std::make_unique<Surface>(width, height);
+}
+
+// Needs no window system, so it also runs on machines without a display, e.g. on a software ICD such as lavapipe.
+Surface::Surface(uint32_t width, uint32_t height) : ISurface(width, height)
+{
+	createInstance({});
+}
+
+bool Surface::isHeadless() const
+{
+	return !m_vkSurfaceKHR;
+}
+
+void Surface::createInstance(std::vector<const char*> extensions)
+{
+	vk::ApplicationInfo appInfo("PapaGo-api", VK_MAKE_VERSION(1, 0, 0), "No Engine", VK_MAKE_VERSION(1, 0, 0), VK_API_VERSION_1_0);
 
 #ifdef PAPAGO_USE_VALIDATION_LAYERS
-	surfaceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
 
+	// Optional, devices report their memory budget through it when they support VK_EXT_memory_budget.
+	m_hasPhysicalDeviceProperties2 = isInstanceExtensionSupported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	if (m_hasPhysicalDeviceProperties2) {
+		extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
+
 
 	std::vector<const char*> requiredLayers = {};
 
@@ -121,8 +164,8 @@ Surface::Surface(uint32_t width, uint32_t height, HWND hwnd) : ISurface(width, h
 		.setEnabledLayerCount(requiredLayers.size())
 		.setPpEnabledLayerNames(requiredLayers.data())
 		.setPApplicationInfo(&appInfo)
-		.setEnabledExtensionCount(surfaceExtensions.size())
-		.setPpEnabledExtensionNames(surfaceExtensions.data()));
+		.setEnabledExtensionCount(extensions.size())
+		.setPpEnabledExtensionNames(extensions.data()));
 
 #ifdef PAPAGO_USE_VALIDATION_LAYERS
 	m_debugReportCallback = m_vkInstance->createDebugReportCallbackEXTUnique(
@@ -136,10 +179,4 @@ Surface::Surface(uint32_t width, uint32_t height, HWND hwnd) : ISurface(width, h
 			)
 			.setPfnCallback(VkDebugCallback));
 #endif
-
-	auto surfaceCreateInfo = vk::Win32SurfaceCreateInfoKHR()
-		.setHwnd(hwnd)
-		.setHinstance(GetModuleHandle(nullptr));
-
-	m_vkSurfaceKHR = m_vkInstance->createWin32SurfaceKHRUnique(surfaceCreateInfo);
 }
@@ -4,15 +4,25 @@
 class Surface : public ISurface
 {
 public:
+#ifdef _WIN32
 	Surface(uint32_t width, uint32_t height, HWND hwnd);
+#endif
+	// Headless, see ISurface::createHeadlessSurface.
+	Surface(uint32_t width, uint32_t height);
 
 	explicit operator vk::SurfaceKHR&();
+	bool isHeadless() const;
+
 	vk::UniqueInstance m_vkInstance;
+	bool m_hasPhysicalDeviceProperties2 = false;	//<-- needed to query VK_EXT_memory_budget
 private:
 	vk::UniqueSurfaceKHR m_vkSurfaceKHR;
 #ifdef PAPAGO_USE_VALIDATION_LAYERS
 	vk::UniqueDebugReportCallbackEXT m_debugReportCallback;
 #endif
 
+	void createInstance(std::vector<const char*> extensions);
+
 	static void checkInstanceLayers(const std::vector<const char*>& requiredLayers);
+	static bool isInstanceExtensionSupported(const char* extensionName);
 };
\ No newline at end of file
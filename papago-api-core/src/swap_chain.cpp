@@ -1,3 +1,4 @@
+#include <limits>
 #include "standard_header.hpp"
 #include "swap_chain.hpp"
 #include "image_resource.hpp"
@@ -8,6 +9,16 @@ SwapChain::operator vk::SwapchainKHR&()
 	return *m_vkSwapChain;
 }
 
+bool SwapChain::isOffscreen() const
+{
+	return !m_vkSwapChain;
+}
+
+bool SwapChain::needsRecreation() const
+{
+	return m_isSuboptimal || m_isOutOfDate;
+}
+
 uint32_t SwapChain::getWidth() const
 {
 	return m_vkExtent.width;
@@ -39,7 +50,6 @@ SwapChain::SwapChain(
 	// this _may_ be error-prone...
 	m_vkRenderPass = device.createVkRenderpass(m_colorResources[0].m_format, m_depthResources[0].m_format);
 	auto swapChainSize = m_colorResources.size();
-	m_vkFences.resize(swapChainSize);
 
 	for (auto i = 0; i < swapChainSize; ++i) {
 		std::vector<vk::ImageView> attachments = {
@@ -58,10 +68,7 @@ SwapChain::SwapChain(
 		m_vkFramebuffers.emplace_back(device.getVkDevice()->createFramebufferUnique(framebufferCreateInfo));
 	}
 
-	//ready fences:
-	vk::UniqueFence fence = device.getVkDevice()->createFenceUnique({});
-	m_currentFramebufferIndex = device.getVkDevice()->acquireNextImageKHR(*m_vkSwapChain, 0, {}, *fence).value;
-	m_vkFences[m_currentFramebufferIndex] = std::move(fence);
+	acquireFirstImage(device);
 }
 
 SwapChain::SwapChain(const Device &device, vk::UniqueSwapchainKHR &swapChain, std::vector<ImageResource>& colorResources, vk::Extent2D extent)
@@ -71,7 +78,6 @@ SwapChain::SwapChain(const Device &device, vk::UniqueSwapchainKHR &swapChain, st
 {
 	m_vkRenderPass = device.createVkRenderpass(m_colorResources[0].m_format);
 	auto swapChainSize = m_colorResources.size();
-	m_vkFences.resize(swapChainSize);
 
 	for (auto i = 0; i < swapChainSize; ++i) {
 		std::vector<vk::ImageView> attachments = {
@@ -89,8 +95,17 @@ SwapChain::SwapChain(const Device &device, vk::UniqueSwapchainKHR &swapChain, st
 		m_vkFramebuffers.emplace_back(device.getVkDevice()->createFramebufferUnique(framebufferCreateInfo));
 	}
 	
-	//ready fences:
-	vk::UniqueFence fence = device.getVkDevice()->createFenceUnique({});
-	m_currentFramebufferIndex = device.getVkDevice()->acquireNextImageKHR(*m_vkSwapChain, 0, {}, *fence).value;
-	m_vkFences[m_currentFramebufferIndex] = std::move(fence);
+	acquireFirstImage(device);
+}
+
+void SwapChain::acquireFirstImage(const Device& device)
+{
+	if (isOffscreen()) {
+		m_currentFramebufferIndex = 0;
+		return;
+	}
+
+	auto fence = device.getVkDevice()->createFenceUnique({});
+	m_currentFramebufferIndex = device.getVkDevice()->acquireNextImageKHR(*m_vkSwapChain, std::numeric_limits<uint64_t>::max(), {}, *fence).value;
+	device.getVkDevice()->waitForFences({ *fence }, true, std::numeric_limits<uint64_t>::max());
 }
@@ -9,20 +9,27 @@ public:
 	SwapChain(const Device&, vk::UniqueSwapchainKHR&, std::vector<ImageResource>& colorResources, vk::Extent2D);
 	
 	explicit operator vk::SwapchainKHR&();
+	// The images are offscreen render targets, see ISurface::createHeadlessSurface.
+	bool isOffscreen() const;
 
 	uint32_t getWidth() const override;
 	uint32_t getHeight() const override;
 	Format getFormat() const override;
+	bool needsRecreation() const override;
 
-	vk::UniqueSwapchainKHR m_vkSwapChain;
+	vk::UniqueSwapchainKHR m_vkSwapChain;	//<-- null for offscreen swapchains
 	std::vector<ImageResource> m_colorResources;
 	std::vector<ImageResource> m_depthResources;
 	std::vector<vk::UniqueFramebuffer> m_vkFramebuffers;
 	vk::UniqueRenderPass m_vkRenderPass;
 	vk::Extent2D m_vkExtent;
-	//Indicates if image resource is ready to be used. Contains one fence per framebuffer.
-	std::vector<vk::UniqueFence> m_vkFences;
 
 	//updated through GraphicsQueue (both present() and constructor)
 	uint32_t m_currentFramebufferIndex;
+	bool m_isSuboptimal = false;
+	bool m_isOutOfDate = false;	//<-- m_currentFramebufferIndex no longer refers to an acquired image
+
+private:
+	// Only used for the first image. Later images are acquired by GraphicsQueue::present, which waits for them on the GPU.
+	void acquireFirstImage(const Device&);
 };
@@ -0,0 +1,218 @@
+#include "standard_header.hpp"
+#include "texture_file.hpp"
+#include "image_resource.hpp"
+#include <fstream>
+#include <cstring>
+
+namespace {
+	template<typename T>
+	T read(const std::vector<char>& data, size_t offset)
+	{
+		if (offset + sizeof(T) > data.size()) {
+			PAPAGO_ERROR("Texture file is truncated!");
+		}
+
+		T value;
+		memcpy(&value, data.data() + offset, sizeof(T));
+		return value;
+	}
+
+	constexpr uint32_t fourCC(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+	}
+
+	// DXGI_FORMAT values used by the DX10 extension of the .dds header
+	Format fromDxgiFormat(uint32_t dxgiFormat)
+	{
+		switch (dxgiFormat)
+		{
+		case 28: return Format::eR8G8B8A8Unorm;
+		case 87: return Format::eB8G8R8A8Unorm;
+		case 71: return Format::eBc1RgbaUnormBlock;
+		case 72: return Format::eBc1RgbaSrgbBlock;
+		case 74: return Format::eBc2UnormBlock;
+		case 75: return Format::eBc2SrgbBlock;
+		case 77: return Format::eBc3UnormBlock;
+		case 78: return Format::eBc3SrgbBlock;
+		case 80: return Format::eBc4UnormBlock;
+		case 81: return Format::eBc4SnormBlock;
+		case 83: return Format::eBc5UnormBlock;
+		case 84: return Format::eBc5SnormBlock;
+		case 95: return Format::eBc6HUfloatBlock;
+		case 96: return Format::eBc6HSfloatBlock;
+		case 98: return Format::eBc7UnormBlock;
+		case 99: return Format::eBc7SrgbBlock;
+		default:
+			PAPAGO_ERROR("Unsupported DXGI format in .dds file: " + std::to_string(dxgiFormat));
+		}
+	}
+
+	const char KTX2_IDENTIFIER[12] = { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+}
+
+TextureFile::TextureFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		PAPAGO_ERROR("Failed to open texture file: " + path);
+	}
+
+	m_data.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(m_data.data(), m_data.size());
+
+	if (m_data.size() >= 4 && read<uint32_t>(m_data, 0) == fourCC('D', 'D', 'S', ' ')) {
+		parseDds();
+	}
+	else if (m_data.size() >= sizeof(KTX2_IDENTIFIER) && memcmp(m_data.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+		parseKtx2();
+	}
+	else {
+		PAPAGO_ERROR("Unknown texture container: " + path);
+	}
+}
+
+const char* TextureFile::getLevelData(uint32_t mipLevel) const
+{
+	return m_data.data() + m_levels.at(mipLevel).offset;
+}
+
+size_t TextureFile::getLevelSize(uint32_t mipLevel) const
+{
+	return m_levels.at(mipLevel).size;
+}
+
+// DDS_HEADER follows the magic number, optionally followed by DDS_HEADER_DXT10 when the pixel format's FourCC is 'DX10'.
+void TextureFile::parseDds()
+{
+	const size_t headerOffset = 4;
+	const size_t pixelFormatOffset = headerOffset + 72;
+
+	m_height = read<uint32_t>(m_data, headerOffset + 8);
+	m_width = read<uint32_t>(m_data, headerOffset + 12);
+	auto mipMapCount = std::max(read<uint32_t>(m_data, headerOffset + 24), 1u);
+
+	auto pixelFormatFlags = read<uint32_t>(m_data, pixelFormatOffset + 4);
+	auto pixelFormatFourCC = read<uint32_t>(m_data, pixelFormatOffset + 8);
+	auto dataOffset = headerOffset + 124;
+
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDPF_RGB = 0x40;
+	const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+	const uint32_t D3D10_RESOURCE_MISC_TEXTURECUBE = 0x4;
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	const uint32_t DDSCAPS2_VOLUME = 0x200000;
+
+	if (read<uint32_t>(m_data, headerOffset + 108) & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) {
+		PAPAGO_ERROR("Only 2D textures are supported in .dds files!");
+	}
+
+	if (pixelFormatFlags & DDPF_FOURCC) {
+		switch (pixelFormatFourCC)
+		{
+		case fourCC('D', 'X', 'T', '1'): m_format = Format::eBc1RgbaUnormBlock; break;
+		case fourCC('D', 'X', 'T', '3'): m_format = Format::eBc2UnormBlock; break;
+		case fourCC('D', 'X', 'T', '5'): m_format = Format::eBc3UnormBlock; break;
+		case fourCC('A', 'T', 'I', '1'):
+		case fourCC('B', 'C', '4', 'U'): m_format = Format::eBc4UnormBlock; break;
+		case fourCC('B', 'C', '4', 'S'): m_format = Format::eBc4SnormBlock; break;
+		case fourCC('A', 'T', 'I', '2'):
+		case fourCC('B', 'C', '5', 'U'): m_format = Format::eBc5UnormBlock; break;
+		case fourCC('B', 'C', '5', 'S'): m_format = Format::eBc5SnormBlock; break;
+		case fourCC('D', 'X', '1', '0'):
+			m_format = fromDxgiFormat(read<uint32_t>(m_data, dataOffset));
+			if (read<uint32_t>(m_data, dataOffset + 4) != D3D10_RESOURCE_DIMENSION_TEXTURE2D || read<uint32_t>(m_data, dataOffset + 8) & D3D10_RESOURCE_MISC_TEXTURECUBE) {
+				PAPAGO_ERROR("Only 2D textures are supported in .dds files!");
+			}
+			if (read<uint32_t>(m_data, dataOffset + 12) > 1) {
+				PAPAGO_ERROR("Texture arrays in .dds files are not supported!");
+			}
+			dataOffset += 20;
+			break;
+		default:
+			PAPAGO_ERROR("Unsupported FourCC in .dds file!");
+		}
+	}
+	else if (pixelFormatFlags & DDPF_RGB && read<uint32_t>(m_data, pixelFormatOffset + 12) == 32) {
+		auto redMask = read<uint32_t>(m_data, pixelFormatOffset + 16);
+		m_format = redMask == 0x000000ff ? Format::eR8G8B8A8Unorm : Format::eB8G8R8A8Unorm;
+	}
+	else {
+		PAPAGO_ERROR("Unsupported pixel format in .dds file!");
+	}
+
+	addPackedLevels(dataOffset, mipMapCount);
+}
+
+// The header is followed by the level index, which stores where every level is. Level 0 is the largest.
+void TextureFile::parseKtx2()
+{
+	const size_t headerOffset = sizeof(KTX2_IDENTIFIER);
+	const size_t levelIndexOffset = headerOffset + 36 + 32;
+
+	auto vkFormat = read<uint32_t>(m_data, headerOffset);
+	m_width = read<uint32_t>(m_data, headerOffset + 8);
+	m_height = std::max(read<uint32_t>(m_data, headerOffset + 12), 1u);
+	auto pixelDepth = read<uint32_t>(m_data, headerOffset + 16);
+	auto layerCount = read<uint32_t>(m_data, headerOffset + 20);
+	auto faceCount = read<uint32_t>(m_data, headerOffset + 24);
+	auto levelCount = std::max(read<uint32_t>(m_data, headerOffset + 28), 1u);
+	auto supercompressionScheme = read<uint32_t>(m_data, headerOffset + 32);
+
+	if (pixelDepth > 1 || layerCount > 1 || faceCount != 1) {
+		PAPAGO_ERROR("Only 2D textures are supported in .ktx2 files!");
+	}
+	if (supercompressionScheme != 0) {
+		PAPAGO_ERROR("Supercompressed .ktx2 files are not supported!");
+	}
+
+	m_format = from_vulkan_format(static_cast<vk::Format>(vkFormat));
+	if (levelCount > ImageResource::getFullMipLevelCount({ m_width, m_height, 1 })) {
+		PAPAGO_ERROR("The .ktx2 file has more levels than its extent allows!");
+	}
+
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		auto entryOffset = levelIndexOffset + level * 24;
+		Level entry;
+		entry.offset = static_cast<size_t>(read<uint64_t>(m_data, entryOffset));
+		entry.size = static_cast<size_t>(read<uint64_t>(m_data, entryOffset + 8));
+
+		if (entry.size != getLevelSizeFromFormat(level)) {
+			PAPAGO_ERROR("Level " + std::to_string(level) + " of the .ktx2 file doesn't match its format and extent!");
+		}
+		if (entry.offset > m_data.size() || entry.size > m_data.size() - entry.offset) {
+			PAPAGO_ERROR("Texture file is truncated!");
+		}
+		m_levels.push_back(entry);
+	}
+}
+
+void TextureFile::addPackedLevels(size_t offset, uint32_t levelCount)
+{
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		Level entry;
+		entry.offset = offset;
+		entry.size = getLevelSizeFromFormat(level);
+
+		if (entry.offset + entry.size > m_data.size()) {
+			PAPAGO_ERROR("Texture file is truncated!");
+		}
+		m_levels.push_back(entry);
+		offset += entry.size;
+	}
+}
+
+size_t TextureFile::getLevelSizeFromFormat(uint32_t mipLevel) const
+{
+	size_t width = std::max(m_width >> mipLevel, 1u);
+	size_t height = std::max(m_height >> mipLevel, 1u);
+
+	auto vkFormat = to_vulkan_format(m_format);
+	auto blockSize = blockSizeOfFormat(vkFormat);
+	if (blockSize) {
+		return ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+	}
+
+	return width * height * sizeOfFormat(vkFormat);
+}
@@ -10,6 +10,12 @@ uint32_t VertexShader::Input::getFormatSize()
 {
 	{
 		switch (format) {
+		case vk::Format::eR32Sfloat:
+			return sizeof(float);
+			break;
+		case vk::Format::eR32G32B32A32Sfloat:
+			return sizeof(float) * 4;
+			break;
 		case vk::Format::eR32G32B32Sfloat:
 			return sizeof(float) * 3;
 			break;
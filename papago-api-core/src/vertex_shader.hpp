@@ -11,14 +11,22 @@ public:
 	{
 		uint32_t offset;	//<-- offset in bytes from the beginning of the vertex data
 		vk::Format format;
+		uint32_t binding;	//<-- the vertex buffer binding the input is read from
 
 		//Returns how many bytes the format of this input uses
 		//TODO: move this utitily somewhere else. -AM
 		uint32_t getFormatSize();
 	};
 
+	struct InputBinding
+	{
+		uint32_t stride = 0;	//<-- 0 if no input is read from the binding
+		vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+	};
+
 	//must be set by parser:
 	std::vector<Input> m_input;	 //<-- the index in this vector = order of in-vars in shader.
+	std::vector<InputBinding> m_inputBindings;	//<-- the index in this vector = the vertex buffer binding
 private:
 	
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "pch.h"
+#include <functional>
+#include "papago.hpp"
+
+// The CMake build points this at the validator it finds.
+#ifndef PARSER_COMPILER_PATH
+#define PARSER_COMPILER_PATH "C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe"
+#endif
+
+std::string fullscreen_vertex_source =
+"#version 450\n"
+"void main(){\n"
+"  gl_Position = vec4(0.0, 0.0, 0.0, 1.0);\n"
+"}\n";
+
+std::string fullscreen_fragment_source =
+"#version 450\n"
+"layout(location = 0) out vec4 color;\n"
+"void main(){\n"
+"  color = vec4(1.0);\n"
+"}\n";
+
+// Frame graphs need a Vulkan device, and the tests fail without one. CMake builds them into papago-api-device-test,
+// apart from the tests that run anywhere.
+class FrameGraphTests : public ::testing::Test {
+protected:
+	void SetUp() override {
+		m_surface = ISurface::createHeadlessSurface(16, 16);
+		auto devices = IDevice::enumerateDevices(*m_surface, {}, {});
+		ASSERT_FALSE(devices.empty()) << "The frame graph tests need a Vulkan device.";
+		m_device = std::move(devices[0]);
+
+		Parser p = Parser(PARSER_COMPILER_PATH);
+		m_vertexShader = p.compileVertexShader(fullscreen_vertex_source, "main");
+		m_fragmentShader = p.compileFragmentShader(fullscreen_fragment_source, "main");
+		m_program = m_device->createShaderProgram(*m_vertexShader, *m_fragmentShader);
+		m_renderPass = m_device->createRenderPass(*m_program, 16, 16, Format::eR8G8B8A8Unorm);
+		m_graph = m_device->createFrameGraph();
+	}
+
+	// Records the name of the pass when the graph records it.
+	std::function<void(IRecordingCommandBuffer&)> recordName(const std::string& name) {
+		return [this, name](IRecordingCommandBuffer&) { m_recorded.push_back(name); };
+	}
+
+	std::unique_ptr<ISurface> m_surface;
+	std::unique_ptr<IDevice> m_device;
+	std::unique_ptr<IVertexShader> m_vertexShader;
+	std::unique_ptr<IFragmentShader> m_fragmentShader;
+	std::unique_ptr<IShaderProgram> m_program;
+	std::unique_ptr<IRenderPass> m_renderPass;
+	std::unique_ptr<IFrameGraph> m_graph;
+	std::vector<std::string> m_recorded;
+};
+
+TEST_F(FrameGraphTests, PassOrder) {
+	auto scene = m_graph->createTransientImage(16, 16, Format::eR8G8B8A8Unorm);
+	auto blurred = m_graph->createTransientImage(16, 16, Format::eR8G8B8A8Unorm);
+	auto target = m_graph->createTransientImage(16, 16, Format::eR8G8B8A8Unorm);
+
+	// Declared in reverse, the samplers run after the passes writing what they sample.
+	m_graph->addPass(*m_renderPass, target, { blurred }, recordName("composite"));
+	m_graph->addPass(*m_renderPass, blurred, { scene }, recordName("blur"));
+	m_graph->addPass(*m_renderPass, scene, {}, recordName("scene"));
+	// Writers of the same image keep their declared order.
+	m_graph->addPass(*m_renderPass, target, {}, recordName("overlay"));
+
+	auto queue = m_device->createGraphicsQueue();
+	m_graph->execute(*queue).wait();
+
+	EXPECT_EQ((std::vector<std::string>{ "scene", "blur", "composite", "overlay" }), m_recorded);
+}
+
+TEST_F(FrameGraphTests, CycleIsRejected) {
+	auto first = m_graph->createTransientImage(16, 16, Format::eR8G8B8A8Unorm);
+	auto second = m_graph->createTransientImage(16, 16, Format::eR8G8B8A8Unorm);
+
+	m_graph->addPass(*m_renderPass, first, { second }, recordName("first"));
+	m_graph->addPass(*m_renderPass, second, { first }, recordName("second"));
+
+	EXPECT_THROW(m_graph->compile(), std::runtime_error);
+}
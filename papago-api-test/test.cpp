@@ -1,6 +1,17 @@
 #include "pch.h"
-#include "parser.hpp"
-#include "ishader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include "papago.hpp"
+// The parser results are only visible on the shader classes of the core.
+#include "standard_header.hpp"
+#include "vertex_shader.hpp"
+
+// The CMake build points this at the validator it finds.
+#ifndef PARSER_COMPILER_PATH
+#define PARSER_COMPILER_PATH "C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe"
+#endif
 
 TEST(TestCaseName, TestName) {
   EXPECT_EQ(1, 1);
@@ -14,7 +25,7 @@ std::string vertex_source =
 "}\n";
 
 TEST(ParserTests, VertexShader) {
-	Parser p = Parser("C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe");
+	Parser p = Parser(PARSER_COMPILER_PATH);
 
 	EXPECT_FALSE(p.compileVertexShader(vertex_source, "main") == nullptr);
 	EXPECT_THROW(p.compileVertexShader("", "main"), std::runtime_error);
@@ -27,8 +38,235 @@ std::string fragment_source =
 "}\n";
 
 TEST(ParserTests, FragmentShader) {
-	Parser p = Parser("C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe");
+	Parser p = Parser(PARSER_COMPILER_PATH);
 
 	EXPECT_FALSE(p.compileFragmentShader(vertex_source, "main") == nullptr);
 	EXPECT_THROW(p.compileFragmentShader("", "main"), std::runtime_error);
 }
+
+std::string instanced_vertex_source =
+"#version 450\n"
+"layout(location = 0) in vec3 position;\n"
+"layout(location = 1) in vec2 uv; // binding = 0\n"
+"layout(location = 2) in mat4 model; // binding = 1, instance\n"
+"void main(){\n"
+"  gl_Position = model * vec4(position, 1.0) + vec4(uv, 0.0, 0.0);\n"
+"}\n";
+
+TEST(ParserTests, VertexInputBindings) {
+	Parser p = Parser(PARSER_COMPILER_PATH);
+
+	auto shader = p.compileVertexShader(instanced_vertex_source, "main");
+	auto& vertexShader = static_cast<VertexShader&>(*shader);
+
+	// The matrix takes a location per column.
+	ASSERT_EQ(6, vertexShader.m_input.size());
+	EXPECT_EQ(0, vertexShader.m_input[0].binding);
+	EXPECT_EQ(0, vertexShader.m_input[0].offset);
+	EXPECT_EQ(0, vertexShader.m_input[1].binding);
+	EXPECT_EQ(12, vertexShader.m_input[1].offset);
+	for (uint32_t column = 0; column < 4; ++column) {
+		auto& input = vertexShader.m_input[2 + column];
+		EXPECT_EQ(1, input.binding);
+		EXPECT_EQ(column * 16, input.offset);
+		EXPECT_TRUE(input.format == vk::Format::eR32G32B32A32Sfloat);
+	}
+
+	ASSERT_EQ(2, vertexShader.m_inputBindings.size());
+	EXPECT_EQ(20, vertexShader.m_inputBindings[0].stride);
+	EXPECT_TRUE(vertexShader.m_inputBindings[0].inputRate == vk::VertexInputRate::eVertex);
+	EXPECT_EQ(64, vertexShader.m_inputBindings[1].stride);
+	EXPECT_TRUE(vertexShader.m_inputBindings[1].inputRate == vk::VertexInputRate::eInstance);
+}
+
+TEST(ParserTests, VertexInputRateConflict) {
+	Parser p = Parser(PARSER_COMPILER_PATH);
+
+	std::string source =
+		"#version 450\n"
+		"layout(location = 0) in vec3 position; // binding = 1\n"
+		"layout(location = 1) in vec4 offset; // binding = 1, instance\n"
+		"void main(){\n"
+		"  gl_Position = vec4(position, 1.0) + offset;\n"
+		"}\n";
+
+	EXPECT_THROW(p.compileVertexShader(source, "main"), std::runtime_error);
+}
+
+TEST(ParserTests, VertexInputLocationHole) {
+	Parser p = Parser(PARSER_COMPILER_PATH);
+
+	std::string source =
+		"#version 450\n"
+		"layout(location = 0) in vec3 position;\n"
+		"layout(location = 2) in vec2 uv;\n"
+		"void main(){\n"
+		"  gl_Position = vec4(position, 1.0) + vec4(uv, 0.0, 0.0);\n"
+		"}\n";
+
+	auto shader = p.compileVertexShader(source, "main");
+	auto& vertexShader = static_cast<VertexShader&>(*shader);
+
+	// The unused location takes no space in the vertex.
+	ASSERT_EQ(3, vertexShader.m_input.size());
+	EXPECT_TRUE(vertexShader.m_input[1].format == vk::Format::eUndefined);
+	EXPECT_EQ(12, vertexShader.m_input[2].offset);
+	EXPECT_EQ(20, vertexShader.m_inputBindings[0].stride);
+}
+
+namespace {
+	void write32(std::vector<char>& data, size_t offset, uint32_t value)
+	{
+		if (data.size() < offset + 4) {
+			data.resize(offset + 4);
+		}
+		memcpy(data.data() + offset, &value, 4);
+	}
+
+	void write64(std::vector<char>& data, size_t offset, uint64_t value)
+	{
+		if (data.size() < offset + 8) {
+			data.resize(offset + 8);
+		}
+		memcpy(data.data() + offset, &value, 8);
+	}
+
+	// TextureFile only reads files, so the test data goes through one.
+	std::string writeTextureFile(const std::string& path, const std::vector<char>& data)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(data.data(), data.size());
+		return path;
+	}
+
+	// A .dds file without pixel data. dx10 holds the fields of DDS_HEADER_DXT10, if the FourCC is 'DX10'.
+	std::vector<char> ddsHeader(uint32_t width, uint32_t height, uint32_t mipMapCount, const char* fourCC, const std::vector<uint32_t>& dx10 = {})
+	{
+		std::vector<char> data(4 + 124);
+		memcpy(data.data(), "DDS ", 4);
+		write32(data, 4, 124);
+		write32(data, 4 + 8, height);
+		write32(data, 4 + 12, width);
+		write32(data, 4 + 24, mipMapCount);
+		write32(data, 4 + 72, 32);
+		write32(data, 4 + 76, 0x4);	// DDPF_FOURCC
+		memcpy(data.data() + 4 + 80, fourCC, 4);
+		for (auto value : dx10) {
+			write32(data, data.size(), value);
+		}
+		return data;
+	}
+
+	// A .ktx2 file with one level of levelSize bytes, stored levelOffset bytes into the file.
+	std::vector<char> ktx2File(uint32_t vkFormat, uint32_t width, uint32_t height, uint32_t faceCount, uint64_t levelOffset, uint64_t levelSize)
+	{
+		const char identifier[12] = { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+		std::vector<char> data(identifier, identifier + sizeof(identifier));
+		write32(data, 12, vkFormat);
+		write32(data, 12 + 4, 1);
+		write32(data, 12 + 8, width);
+		write32(data, 12 + 12, height);
+		write32(data, 12 + 16, 0);
+		write32(data, 12 + 20, 0);
+		write32(data, 12 + 24, faceCount);
+		write32(data, 12 + 28, 1);
+		write32(data, 12 + 32, 0);
+		write64(data, 80, levelOffset);
+		write64(data, 80 + 8, levelSize);
+		write64(data, 80 + 16, levelSize);
+		data.resize(std::max<size_t>(data.size(), 104));
+		return data;
+	}
+}
+
+TEST(TextureFileTests, DdsBlockCompressedLevels) {
+	// 4x4, 2x2 and 1x1 all take a single 8 byte block.
+	auto data = ddsHeader(4, 4, 3, "DXT1");
+	for (char level = 0; level < 3; ++level) {
+		data.insert(data.end(), 8, level);
+	}
+
+	TextureFile file(writeTextureFile("papago-test.dds", data));
+	std::remove("papago-test.dds");
+
+	EXPECT_TRUE(file.getFormat() == Format::eBc1RgbaUnormBlock);
+	EXPECT_EQ(4, file.getWidth());
+	EXPECT_EQ(4, file.getHeight());
+	ASSERT_EQ(3, file.getMipLevels());
+	for (uint32_t level = 0; level < 3; ++level) {
+		EXPECT_EQ(8, file.getLevelSize(level));
+		EXPECT_EQ(char(level), file.getLevelData(level)[0]);
+	}
+}
+
+TEST(TextureFileTests, DdsDx10Header) {
+	auto data = ddsHeader(2, 2, 1, "DX10", { 28, 3, 0, 1, 0 });	// R8G8B8A8_UNORM, TEXTURE2D
+	data.resize(data.size() + 2 * 2 * 4);
+
+	TextureFile file(writeTextureFile("papago-test.dds", data));
+	std::remove("papago-test.dds");
+
+	EXPECT_TRUE(file.getFormat() == Format::eR8G8B8A8Unorm);
+	ASSERT_EQ(1, file.getMipLevels());
+	EXPECT_EQ(16, file.getLevelSize(0));
+}
+
+TEST(TextureFileTests, DdsErrors) {
+	// The last level is missing a byte.
+	auto truncated = ddsHeader(4, 4, 3, "DXT1");
+	truncated.resize(truncated.size() + 3 * 8 - 1);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.dds", truncated)), std::runtime_error);
+
+	// The header ends before the pixel format.
+	auto truncatedHeader = ddsHeader(4, 4, 1, "DXT1");
+	truncatedHeader.resize(40);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.dds", truncatedHeader)), std::runtime_error);
+
+	auto volume = ddsHeader(2, 2, 1, "DX10", { 28, 4, 0, 1, 0 });	// TEXTURE3D
+	volume.resize(volume.size() + 2 * 2 * 4);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.dds", volume)), std::runtime_error);
+
+	auto array = ddsHeader(2, 2, 1, "DX10", { 28, 3, 0, 2, 0 });
+	array.resize(array.size() + 2 * 2 * 4 * 2);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.dds", array)), std::runtime_error);
+
+	std::remove("papago-test.dds");
+}
+
+TEST(TextureFileTests, Ktx2Level) {
+	auto data = ktx2File(37, 2, 2, 1, 104, 16);	// VK_FORMAT_R8G8B8A8_UNORM
+	data.resize(104 + 16, 7);
+
+	TextureFile file(writeTextureFile("papago-test.ktx2", data));
+	std::remove("papago-test.ktx2");
+
+	EXPECT_TRUE(file.getFormat() == Format::eR8G8B8A8Unorm);
+	EXPECT_EQ(2, file.getWidth());
+	EXPECT_EQ(2, file.getHeight());
+	ASSERT_EQ(1, file.getMipLevels());
+	EXPECT_EQ(16, file.getLevelSize(0));
+	EXPECT_EQ(7, file.getLevelData(0)[0]);
+}
+
+TEST(TextureFileTests, Ktx2Errors) {
+	// The level index points past the end of the file.
+	auto truncated = ktx2File(37, 2, 2, 1, 104, 16);
+	truncated.resize(104 + 15);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.ktx2", truncated)), std::runtime_error);
+
+	// The file ends inside the level index.
+	auto truncatedIndex = ktx2File(37, 2, 2, 1, 104, 16);
+	truncatedIndex.resize(90);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.ktx2", truncatedIndex)), std::runtime_error);
+
+	// A 2x2 RGBA8 level is 16 bytes.
+	auto wrongLevelSize = ktx2File(37, 2, 2, 1, 104, 12);
+	wrongLevelSize.resize(104 + 16);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.ktx2", wrongLevelSize)), std::runtime_error);
+
+	auto cube = ktx2File(37, 2, 2, 6, 104, 16);
+	cube.resize(104 + 16);
+	EXPECT_THROW(TextureFile(writeTextureFile("papago-test.ktx2", cube)), std::runtime_error);
+
+	std::remove("papago-test.ktx2");
+}